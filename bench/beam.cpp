@@ -0,0 +1,204 @@
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if __has_include(<tbb/global_control.h>)
+#include <tbb/global_control.h>
+#define SGBUST_HAS_TBB_GLOBAL_CONTROL
+#endif
+
+#include "core/Beam.h"
+#include "core/BumpArena.h"
+#include "core/Grid.h"
+#include "core/GridHash.h"
+
+using namespace sgbust;
+
+namespace
+{
+    constexpr std::size_t NumParents = 2048;
+    constexpr double MinDuration = 0.5;
+
+    struct Child
+    {
+        sgbust::Grid Grid;
+        std::uint32_t Hash;
+    };
+
+    // Children of random grids, every one of them twice since the beam sees many duplicates
+    std::vector<Child> GenerateChildren(unsigned int width, unsigned int height)
+    {
+        std::mt19937 generator(0);
+        std::vector<Child> children;
+        GroupList groups;
+
+        for (std::size_t i = 0; i < NumParents; i++)
+        {
+            Grid grid = Grid::GenerateRandom(static_cast<unsigned char>(width), static_cast<unsigned char>(height), 4, generator);
+            grid.GetGroups(groups, 2);
+            std::uint32_t hash = HashGrid(grid);
+
+            for (std::size_t j = 0; j < groups.size(); j++)
+            {
+                Grid child = grid;
+                child.RemoveGroup(groups[j]);
+                std::uint32_t childHash = UpdateGridHash(hash, grid, groups[j], child);
+                children.push_back(Child{ child, childHash });
+                children.push_back(Child{ std::move(child), childHash });
+            }
+        }
+
+        std::shuffle(children.begin(), children.end(), generator);
+        return children;
+    }
+
+    void RunBenchmark(unsigned int width, unsigned int height, unsigned int maxThreads)
+    {
+        using Clock = std::chrono::steady_clock;
+
+        std::vector<Child> children = GenerateChildren(width, height);
+
+        std::cout << std::format("{}x{} ({} children, throughput in million children per second)\n", width, height, children.size());
+
+        std::optional<double> baseThroughput;
+
+        for (unsigned int numThreads = 1; ; numThreads = std::min(numThreads * 2, maxThreads))
+        {
+#ifdef SGBUST_HAS_TBB_GLOBAL_CONTROL
+            tbb::global_control control(tbb::global_control::max_allowed_parallelism, numThreads);
+#endif
+
+            Beam beam;
+            BumpArena arena;
+
+            std::chrono::duration<double> addDuration{};
+            std::chrono::duration<double> mergeDuration{};
+            std::size_t runs = 0;
+            std::size_t numGrids = 0;
+
+            do
+            {
+                beam.Clear();
+                arena.Reset();
+
+                auto start = Clock::now();
+
+                std::vector<std::jthread> threads;
+                for (unsigned int t = 0; t < numThreads; t++)
+                    threads.emplace_back([&, t] {
+                        for (std::size_t i = t; i < children.size(); i += numThreads)
+                            beam.Add(children[i].Grid, children[i].Hash, Score(0), MoveLink());
+                        });
+                threads.clear();
+
+                auto merge = Clock::now();
+                numGrids = beam.Merge(arena);
+                auto end = Clock::now();
+
+                addDuration += merge - start;
+                mergeDuration += end - merge;
+                runs++;
+            } while ((addDuration + mergeDuration).count() < MinDuration);
+
+            double numChildren = static_cast<double>(children.size()) * runs;
+            double throughput = numChildren / (addDuration + mergeDuration).count() / 1e6;
+            if (!baseThroughput.has_value())
+                baseThroughput = throughput;
+
+            std::cout << std::format("  {:3} threads  add {:7.2f}  merge {:7.2f}  total {:7.2f}  speedup {:5.2f}  ({} unique)\n", numThreads,
+                numChildren / addDuration.count() / 1e6, numChildren / mergeDuration.count() / 1e6, throughput, throughput / *baseThroughput, numGrids);
+
+            if (numThreads == maxThreads)
+                break;
+        }
+    }
+
+    // Grows a beam to numGrids grids by merging batches of children of random grids, and reports how fast
+    // the children are inserted while the size of the beam doubles, once without and once with prefetching
+    void RunInsertBenchmark(unsigned int width, unsigned int height, std::size_t numGrids, unsigned int maxThreads)
+    {
+        using Clock = std::chrono::steady_clock;
+        constexpr std::size_t BatchSize = 1 << 16;
+        constexpr std::size_t FirstReport = 1 << 20;
+
+        std::cout << std::format("{}x{} up to {} grids ({} threads, insert throughput in million children per second)\n", width, height, numGrids, maxThreads);
+
+#ifdef SGBUST_HAS_TBB_GLOBAL_CONTROL
+        tbb::global_control control(tbb::global_control::max_allowed_parallelism, maxThreads);
+#endif
+
+        for (std::size_t prefetchDistance : { std::size_t(0), Beam::DefaultPrefetchDistance })
+        {
+            Beam beam;
+            beam.SetPrefetchDistance(prefetchDistance);
+            BumpArena arena;
+            std::mt19937 generator(0);
+            GroupList groups;
+            Grid child(0, 0);
+
+            std::chrono::duration<double> mergeDuration{};
+            std::size_t numMerged = 0;
+            std::size_t nextReport = FirstReport;
+
+            std::cout << std::format("  prefetch distance {}:", prefetchDistance);
+
+            while (beam.MergedSize() < numGrids)
+            {
+                std::size_t numAdded = 0;
+                while (numAdded < BatchSize)
+                {
+                    Grid grid = Grid::GenerateRandom(static_cast<unsigned char>(width), static_cast<unsigned char>(height), 3, generator);
+                    std::uint32_t hash = HashGrid(grid);
+                    grid.GetGroups(groups, 2);
+
+                    for (Group group : groups)
+                    {
+                        child.RemoveGroup(grid, group);
+                        beam.Add(child, UpdateGridHash(hash, grid, group, child), Score(0), MoveLink());
+                        numAdded++;
+                    }
+                }
+
+                auto start = Clock::now();
+                beam.Merge(arena);
+                mergeDuration += Clock::now() - start;
+                numMerged += numAdded;
+
+                if (beam.MergedSize() >= nextReport || beam.MergedSize() >= numGrids)
+                {
+                    std::cout << std::format("  {:.1f}M {:.2f}", beam.MergedSize() / 1e6, numMerged / mergeDuration.count() / 1e6) << std::flush;
+                    mergeDuration = {};
+                    numMerged = 0;
+                    while (nextReport <= beam.MergedSize())
+                        nextReport *= 2;
+                }
+            }
+
+            std::cout << "\n";
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned int maxThreads = argc > 1 ? std::stoi(argv[1]) : std::max(std::thread::hardware_concurrency(), 1u);
+    std::size_t numGrids = argc > 2 ? std::stoull(argv[2]) : 10'000'000;
+
+#ifndef SGBUST_HAS_TBB_GLOBAL_CONTROL
+    std::cout << "Merging always uses all cores since the parallel algorithms are not backed by TBB\n";
+#endif
+
+    RunBenchmark(15, 15, maxThreads);
+    RunBenchmark(20, 20, maxThreads);
+    RunInsertBenchmark(10, 10, numGrids, maxThreads);
+    return 0;
+}
\ No newline at end of file
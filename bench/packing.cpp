@@ -0,0 +1,92 @@
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <format>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "core/BlockPacking.h"
+#include "core/Grid.h"
+
+using namespace sgbust;
+
+namespace
+{
+    constexpr std::size_t NumGrids = 4096;
+    constexpr double MinDuration = 0.5;
+
+    template <typename Func>
+    double MeasureThroughput(std::size_t bytesPerRun, Func func)
+    {
+        using Clock = std::chrono::steady_clock;
+
+        std::size_t runs = 0;
+        auto start = Clock::now();
+        std::chrono::duration<double> elapsed;
+        do
+        {
+            func();
+            runs++;
+            elapsed = Clock::now() - start;
+        } while (elapsed.count() < MinDuration);
+
+        return bytesPerRun * runs / elapsed.count() / 1e9;
+    }
+
+    void RunBenchmark(unsigned char width, unsigned char height)
+    {
+        std::size_t numBlocks = width * height;
+        std::size_t dataLength = (numBlocks * 3 + 7) / 8;
+
+        std::mt19937 generator(0);
+        std::vector<Block> blocks(NumGrids * numBlocks);
+        for (std::size_t i = 0; i < NumGrids; i++)
+        {
+            Grid grid = Grid::GenerateRandom(width, height, 5, generator);
+            std::copy(grid.BlocksBegin(), grid.BlocksEnd(), blocks.begin() + i * numBlocks);
+        }
+
+        SetPackingKernel(PackingKernel::Scalar);
+        std::vector<std::byte> expectedData(NumGrids * dataLength);
+        for (std::size_t i = 0; i < NumGrids; i++)
+            PackBlocks(&blocks[i * numBlocks], numBlocks, &expectedData[i * dataLength]);
+
+        std::cout << std::format("{}x{} ({} grids, throughput in GB/s of unpacked blocks)\n", width, height, NumGrids);
+
+        for (PackingKernel kernel : { PackingKernel::Scalar, PackingKernel::Bmi2, PackingKernel::Ssse3, PackingKernel::Avx2, PackingKernel::Avx512 })
+        {
+            if (!IsPackingKernelSupported(kernel))
+            {
+                std::cout << std::format("  {:<8} not supported\n", GetPackingKernelName(kernel));
+                continue;
+            }
+
+            SetPackingKernel(kernel);
+
+            std::vector<std::byte> data(NumGrids * dataLength);
+            std::vector<Block> unpacked(NumGrids * numBlocks);
+
+            double packThroughput = MeasureThroughput(blocks.size(), [&] {
+                for (std::size_t i = 0; i < NumGrids; i++)
+                    PackBlocks(&blocks[i * numBlocks], numBlocks, &data[i * dataLength]);
+                });
+            double unpackThroughput = MeasureThroughput(blocks.size(), [&] {
+                for (std::size_t i = 0; i < NumGrids; i++)
+                    UnpackBlocks(&data[i * dataLength], numBlocks, &unpacked[i * numBlocks]);
+                });
+
+            bool correct = data == expectedData && unpacked == blocks;
+
+            std::cout << std::format("  {:<8} pack {:6.2f}  unpack {:6.2f}{}\n", GetPackingKernelName(kernel),
+                packThroughput, unpackThroughput, correct ? "" : "  MISMATCH");
+        }
+    }
+}
+
+int main()
+{
+    RunBenchmark(15, 15);
+    RunBenchmark(20, 20);
+    return 0;
+}
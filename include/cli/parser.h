@@ -7,6 +7,7 @@
 
 #include "core/Polynom.h"
 #include "core/Scoring.h"
+#include "core/Solver.h"
 
 enum class ScoringType
 {
@@ -31,9 +32,17 @@ struct SolveCLIOptions
     std::string SolutionPrefix;
     std::optional<unsigned int> MaxBeamSize = std::nullopt;
     std::optional<unsigned int> MaxDepth = std::nullopt;
+    std::optional<double> TimeLimit = std::nullopt;
+    std::optional<unsigned int> MaxMemory = std::nullopt;
+    std::optional<std::string> SpillDirectory = std::nullopt;
+    std::optional<std::string> CheckpointFile = std::nullopt;
+    unsigned int CheckpointInterval = 10;
+    bool Resume = false;
+    std::optional<std::string> EmitImprovements = std::nullopt;
     bool ClearingSolutionsOnly = false;
-    bool TrimmingEnabled = true;
-    double TrimmingSafetyFactor = 1.25;
+    sgbust::HashTableBackend HashTable = sgbust::HashTableBackend::Phmap;
+    std::optional<unsigned int> TranspositionTableSize = std::nullopt;
+    bool Deterministic = false;
     bool Quiet = false;
 };
 
@@ -64,6 +73,9 @@ struct BenchmarkCLIOptions
     std::optional<unsigned int> NumGrids = std::nullopt;
     ::ScoringOptions ScoringOptions;
     std::optional<unsigned int> MaxBeamSize = std::nullopt;
+    sgbust::HashTableBackend HashTable = sgbust::HashTableBackend::Phmap;
+    std::optional<unsigned int> TranspositionTableSize = std::nullopt;
+    bool Deterministic = false;
 };
 
 using CLIOptions = std::variant<
@@ -0,0 +1,195 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <thread>
+#include <vector>
+
+#include "core/BumpArena.h"
+#include "core/CompactGrid.h"
+#include "core/Grid.h"
+#include "core/GridTable.h"
+#include "core/MoveHistory.h"
+#include "core/Scoring.h"
+#include "mimalloc.h"
+#include "parallel_hashmap/phmap.h"
+
+namespace sgbust
+{
+    using GridHashSet = phmap::flat_hash_set<CompactGrid, std::hash<CompactGrid>, std::equal_to<CompactGrid>, mi_stl_allocator<CompactGrid>>;
+
+    // The hash set that stores the merged grids of every partition of a beam
+    enum class HashTableBackend
+    {
+        Phmap,
+        // GridTable, which is grown ahead of every merge instead of while grids are inserted
+        OpenAddressing
+    };
+
+    // The grids of one depth of the beam search. Grids are deduplicated regardless of their scores in a hash set
+    // that is split into partitions by hash. Threads add grids to buffers of their own, which Merge then inserts
+    // into the partitions, with every partition being merged by a single thread at a time.
+    // Buffered grids are kept in one of several slots, so that grids can be added to one slot while another is merged.
+    // Once all grids are merged, Sort groups them into buckets of equal scores, which are then processed
+    // from the best to the worst score.
+    // With a maximum size, the beam keeps a histogram of the scores of its grids. Grids whose scores are worse than
+    // those of at least as many grids as the maximum size can never be among the best ones and are not admitted.
+    class Beam
+    {
+    public:
+        // A range of sorted grids with equal scores
+        struct Bucket
+        {
+            sgbust::Score Score;
+            std::size_t Begin;
+            std::size_t End;
+        };
+
+    private:
+        static constexpr unsigned int PartitionBits = 6;
+
+    public:
+        static constexpr std::size_t NumPartitions = std::size_t(1) << PartitionBits;
+        static constexpr unsigned int NumSlots = 2;
+        // number of grids ahead of the one being inserted whose slots are prefetched during merges
+        static constexpr std::size_t DefaultPrefetchDistance = 8;
+
+    private:
+
+        // score ranges of up to this many values, or of up to as many values as there are grids,
+        // are bucketed by score offset instead of being sorted by comparison
+        static constexpr std::size_t MinFlatBucketRange = 1 << 16;
+
+        struct PendingGrid
+        {
+            std::size_t Hash;
+            CompactGrid Grid;
+        };
+
+        // grids added by one thread since the last merge, by slot and partition
+        struct PendingBuffer
+        {
+            std::thread::id Owner;
+            std::array<std::array<std::vector<PendingGrid>, NumPartitions>, NumSlots> Slots;
+            PendingBuffer* Next = nullptr;
+        };
+
+        std::array<GridHashSet, NumPartitions> partitions;
+        // used instead of partitions with HashTableBackend::OpenAddressing
+        std::array<GridTable, NumPartitions> tables;
+        HashTableBackend hashTable = HashTableBackend::Phmap;
+        // held while a partition is merged or iterated
+        mutable std::array<std::mutex, NumPartitions> partitionMutexes;
+        // changes to the score histogram by the last merge of every partition
+        std::array<std::map<std::int64_t, std::ptrdiff_t>, NumPartitions> histogramChanges;
+        std::optional<std::size_t> maxSize;
+        bool deterministic = false;
+        std::size_t prefetchDistance = DefaultPrefetchDistance;
+        // number of grids by score bin, only kept with a maximum size
+        std::map<std::int64_t, std::size_t> histogram;
+        std::atomic<std::int64_t> admissionLimit = std::numeric_limits<std::int64_t>::max();
+        // number of times a hash set moved its grids to grow, since the last call to Clear
+        std::atomic<std::size_t> numRehashes = 0;
+        std::vector<std::unique_ptr<PendingBuffer>> pendingBuffers;
+        // the pending buffers as a list that can be walked while threads register new buffers
+        std::atomic<PendingBuffer*> firstPendingBuffer = nullptr;
+        // hold the block data of pending grids until they are merged, by slot
+        std::array<BumpArena, NumSlots> pendingArenas;
+        std::mutex mutex;
+        std::uint64_t generation;
+        std::vector<const CompactGrid*> sortedGrids;
+        std::vector<Bucket> buckets;
+        double bytesPerGrid = 0.0;
+
+        PendingBuffer& GetPendingBuffer();
+        void UpdateAdmissionLimit();
+
+        // scores are binned by their objective, which for integer objectives gives exact bins
+        static std::int64_t GetBin(const Score& score) { return static_cast<std::int64_t>(std::floor(score.Objective)); }
+
+    public:
+        Beam();
+        Beam(const Beam&) = delete;
+        Beam& operator=(const Beam&) = delete;
+
+        // Sets the number of grids that Trim is going to keep. Must be called while the beam is empty.
+        void SetMaxSize(std::optional<std::size_t> size) { maxSize = size; }
+        // Makes Sort order grids with equal scores by their contents, so that the buckets do not depend on the order
+        // in which grids were merged
+        void SetDeterministic(bool deterministic) { this->deterministic = deterministic; }
+        // Selects the hash set of the partitions. Must be called while the beam is empty.
+        void SetHashTable(HashTableBackend hashTable) { this->hashTable = hashTable; }
+        // Makes room for numGrids merged grids in total, so that the hash sets need not grow while grids are merged.
+        // Must not be called concurrently with merges.
+        void Reserve(std::size_t numGrids);
+        // Sets how many grids ahead merges prefetch the slots of, with zero disabling prefetching. Meant for benchmarking only.
+        void SetPrefetchDistance(std::size_t distance) { prefetchDistance = distance; }
+        // Returns whether a grid with the given score may still be among the best ones. Can be called concurrently with Add.
+        bool Admits(const Score& score) const { return GetBin(score) <= admissionLimit.load(std::memory_order_relaxed); }
+        // Buffers a grid in the given slot to be inserted by the next merge of the slot.
+        // May be called concurrently, also with merges of other slots.
+        void Add(const Grid& grid, std::uint32_t hash, const Score& score, const MoveLink& history, unsigned int slot = 0);
+        // Inserts all grids buffered in the slot, storing the block data of new grids in arena, and returns the number of new grids.
+        // If an identical grid is already in the beam, it keeps the better of both scores together with the history that led to it,
+        // or the lesser history if both scores are equal.
+        std::size_t Merge(BumpArena& arena, unsigned int slot = 0);
+        // Merge split into steps for callers that schedule the partitions themselves: MergePartition must be called once
+        // for every partition, possibly concurrently, followed by FinishMerge. Only one slot may be merged at a time.
+        std::size_t MergePartition(std::size_t partition, BumpArena& arena, unsigned int slot);
+        void FinishMerge(unsigned int slot);
+        // Groups the grids into buckets. Must be called after all grids are merged and before the buckets are used.
+        void Sort();
+        // Drops all but the size grids with the best scores from the buckets
+        void Trim(std::size_t size);
+        // Removes all merged grids once they are stored elsewhere, such as in a DiskBeam. Grids are still admitted
+        // as if the removed grids were kept. Must not be called concurrently with merges.
+        void DropMerged();
+        void Clear();
+
+        const std::vector<Bucket>& GetBuckets() const { return buckets; }
+        // All grids in the buckets, sorted by score
+        std::span<const CompactGrid* const> GetGrids() const { return sortedGrids; }
+        // Number of grids in the buckets
+        std::size_t Size() const { return sortedGrids.size(); }
+        // Number of merged grids, including those that were trimmed
+        std::size_t MergedSize() const;
+        // Average number of bytes a merged grid takes up in the hash set and with its block data, as of the last call to Sort
+        double GetBytesPerGrid() const { return bytesPerGrid; }
+        // Number of times a hash set grew while it held grids since the last call to Clear
+        std::size_t GetNumRehashes() const { return numRehashes.load(std::memory_order_relaxed); }
+        // Number of bytes the merged grids take up in the hash set, without their block data
+        std::size_t GetMergedMemoryUsage() const;
+        // Number of bytes used by the pending buffers and the block data of pending grids, which are kept for reuse
+        std::size_t GetPendingMemoryUsage() const;
+        // Frees the memory kept for pending grids. Must not be called while grids are pending.
+        void ReleasePendingMemory();
+
+        // Calls f for every merged grid, including those that were trimmed. May be called concurrently with merges.
+        template <typename F>
+        void ForEach(F f) const;
+    };
+
+    template <typename F>
+    void Beam::ForEach(F f) const
+    {
+        for (std::size_t i = 0; i < NumPartitions; i++)
+        {
+            std::scoped_lock lock(partitionMutexes[i]);
+            if (hashTable == HashTableBackend::OpenAddressing)
+                tables[i].ForEach(f);
+            else
+                for (const CompactGrid& grid : partitions[i])
+                    f(grid);
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+
+#include "core/Grid.h"
+
+namespace sgbust
+{
+    // Blocks are packed with 3 bits per block, every 8 blocks taking up 3 bytes.
+    // All kernels produce the same byte layout and zero all padding bits.
+    enum class PackingKernel
+    {
+        Scalar,
+        Bmi2,
+        Ssse3,
+        Avx2,
+        Avx512
+    };
+
+    void PackBlocks(const Block* blocks, std::size_t numBlocks, std::byte* data);
+    void UnpackBlocks(const std::byte* data, std::size_t numBlocks, Block* blocks);
+
+    // Returns a mask with bit i set if a block with value i is present.
+    unsigned int GetBlockColors(const Block* blocks, std::size_t numBlocks);
+
+    // Packs blocks with 1 or 2 bits per block, after mapping each block to the code given by codes.
+    // Unpacking maps codes back to the blocks given by blocksByCode.
+    void PackBlockCodes(const Block* blocks, std::size_t numBlocks, unsigned int bitsPerBlock, const std::array<unsigned char, 8>& codes, std::byte* data);
+    void UnpackBlockCodes(const std::byte* data, std::size_t numBlocks, unsigned int bitsPerBlock, const std::array<Block, 4>& blocksByCode, Block* blocks);
+
+    // The fastest kernel supported by the CPU is selected on startup.
+    // Changing the kernel is not thread-safe and meant for benchmarking only.
+    bool IsPackingKernelSupported(PackingKernel kernel);
+    PackingKernel GetPackingKernel();
+    void SetPackingKernel(PackingKernel kernel);
+    const char* GetPackingKernelName(PackingKernel kernel);
+}
\ No newline at end of file
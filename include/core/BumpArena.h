@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace sgbust
+{
+    // Hands out memory from large chunks, with every thread bumping a pointer through a chunk of its own,
+    // and releases all allocations at once. Meant for data that lives exactly as long as one depth of the beam.
+    class BumpArena
+    {
+        static constexpr std::size_t ChunkSize = 1 << 20;
+
+        struct Chunk
+        {
+            std::unique_ptr<std::byte[]> Data;
+            std::size_t Size;
+        };
+
+        std::mutex mutex;
+        std::vector<Chunk> chunks;
+        std::vector<Chunk> freeChunks;
+        std::uint64_t generation;
+
+        Chunk TakeChunk(std::size_t minSize);
+
+    public:
+        BumpArena();
+        BumpArena(const BumpArena&) = delete;
+        BumpArena& operator=(const BumpArena&) = delete;
+
+        // May be called concurrently, but not concurrently with Reset or Clear
+        std::byte* Allocate(std::size_t size);
+        // Gives back memory if it is the latest allocation of the calling thread, otherwise does nothing
+        void Deallocate(const std::byte* data, std::size_t size);
+        // Releases all allocations, keeping the chunks for reuse
+        void Reset();
+        // Releases all allocations and frees all chunks
+        void Clear();
+        // Number of bytes in all chunks, including those kept for reuse. Must not be called concurrently with Allocate.
+        std::size_t GetMemoryUsage() const;
+    };
+}
\ No newline at end of file
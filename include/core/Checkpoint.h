@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <vector>
+
+#include "core/CompactGrid.h"
+#include "core/Grid.h"
+#include "core/MoveHistory.h"
+#include "core/Scoring.h"
+#include "core/Solution.h"
+
+namespace sgbust
+{
+    // The state of a beam search between two depths, apart from the grids of the beam
+    struct CheckpointState
+    {
+        // the grid the search started from, after the solution prefix, so that it is only resumed for the same grid
+        Grid StartGrid = Grid(0, 0);
+        unsigned int MinGroupSize = 0;
+        Score StartScore = Score(0);
+        unsigned int Depth = 0;
+        unsigned int BeamSize = 0;
+        unsigned int GridsDiscarded = 0;
+        // what the beam width is adapted to with a memory limit
+        std::size_t MergedBeyondKept = 0;
+        std::size_t PendingMemoryUsage = 0;
+        std::optional<int> BestScore;
+        Solution BestSolution;
+        MoveLink BestLink;
+        unsigned int BestDepth = 0;
+        std::vector<std::vector<MoveLink>> History;
+    };
+
+    // Writes a checkpoint into a temporary file that only replaces the checkpoint file once it is complete,
+    // so that a search that is killed in the meantime can still be resumed from the previous checkpoint.
+    // The grids of the beam follow the state, so that they can be written while they are streamed from disk.
+    class CheckpointWriter
+    {
+        std::filesystem::path path;
+        std::filesystem::path tempPath;
+        std::vector<char> buffer;
+        std::ofstream file;
+        std::streampos numGridsPosition;
+        std::uint64_t numGrids = 0;
+        bool committed = false;
+
+    public:
+        CheckpointWriter(std::filesystem::path path, const CheckpointState& state);
+        CheckpointWriter(const CheckpointWriter&) = delete;
+        CheckpointWriter& operator=(const CheckpointWriter&) = delete;
+        ~CheckpointWriter();
+
+        // Appends a grid of the beam. Grids are expected in the order in which they are expanded.
+        void Write(const CompactGrid& grid);
+        // Completes the checkpoint and replaces the checkpoint file with it
+        void Commit();
+    };
+
+    class CheckpointReader
+    {
+        std::filesystem::path path;
+        std::vector<char> buffer;
+        std::ifstream file;
+        CheckpointState state;
+        std::uint64_t numGrids = 0;
+        std::uint64_t numRead = 0;
+        std::vector<std::byte> data;
+
+    public:
+        explicit CheckpointReader(std::filesystem::path path);
+
+        const CheckpointState& GetState() const { return state; }
+        std::uint64_t GetNumberOfGrids() const { return numGrids; }
+        // Reads the next grid of the beam, returns false after the last one
+        bool Read(CompactGrid& grid);
+    };
+}
\ No newline at end of file
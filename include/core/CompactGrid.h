@@ -1,33 +1,98 @@
 #pragma once
 
+#include <algorithm>
 #include <cstddef>
-#include <memory>
+#include <cstdint>
+#include <functional>
 
+#include "core/BumpArena.h"
 #include "core/Grid.h"
+#include "core/MoveHistory.h"
+#include "core/Scoring.h"
+
+// Maximum number of bytes of block data a CompactGrid stores inline before falling back to the heap.
+// The default makes a CompactGrid take up 32 bytes.
+#ifndef SGBUST_COMPACT_GRID_INLINE_CAPACITY
+#define SGBUST_COMPACT_GRID_INLINE_CAPACITY 11
+#endif
 
 namespace sgbust
 {
 #pragma pack(push, 1)
+    // Stores a grid with as few bits per block as needed for the colors present in it.
+    // Grids with up to three colors are stored with their colors remapped to the codes 1..3 in ascending order,
+    // so that identical grids always have identical data.
+    // Block data that fits into InlineCapacity bytes is stored inline so that small grids do not need an allocation.
+    // Larger block data is stored on the heap or, for grids in the beam, in a BumpArena that owns it.
     struct CompactGrid
     {
+        static constexpr std::size_t InlineCapacity = std::max<std::size_t>(SGBUST_COMPACT_GRID_INLINE_CAPACITY, sizeof(std::byte*));
+
         unsigned char Width;
         unsigned char Height;
-        std::unique_ptr<std::byte[]> Data;
-        sgbust::Solution Solution;
+        unsigned char Colors; // bit i is set if color i is present
+        MoveLink History; // the move that led to this grid, see MoveHistory
+        sgbust::Score Score; // not part of the identity of the grid
+        std::uint32_t Hash; // see HashGrid, carried along so that the block data never needs to be hashed
 
         CompactGrid();
         CompactGrid(const CompactGrid& grid);
+        CompactGrid(const CompactGrid& grid, BumpArena& arena);
         CompactGrid(CompactGrid&& grid) noexcept;
-        CompactGrid(const Grid& grid);
-        CompactGrid(Grid&& grid);
+        CompactGrid(const Grid& grid, const sgbust::Score& score = sgbust::Score(0), const MoveLink& history = {});
+        CompactGrid(const Grid& grid, std::uint32_t hash, const sgbust::Score& score, const MoveLink& history, BumpArena& arena);
+        // Creates a grid from block data packed by a grid with the same size and colors
+        CompactGrid(unsigned char width, unsigned char height, unsigned char colors, const std::byte* data, std::uint32_t hash, const sgbust::Score& score, const MoveLink& history);
         CompactGrid& operator=(const CompactGrid& grid);
         CompactGrid& operator=(CompactGrid&& grid) noexcept;
+        ~CompactGrid();
 
+        unsigned int BitsPerBlock() const;
         std::size_t DataLength() const;
+        const std::byte* Data() const { return IsInline() ? inlineData : heapData; }
+        unsigned int GetNumberOfBlocks() const;
         Grid Expand() const;
 
     private:
-        void Compact(const Grid& grid);
+        bool dataInArena;
+        union
+        {
+            std::byte* heapData;
+            std::byte inlineData[InlineCapacity];
+        };
+
+        bool IsInline() const { return DataLength() <= InlineCapacity; }
+        std::byte* Allocate(BumpArena* arena);
+        void Free();
+        void Compact(const Grid& grid, BumpArena* arena);
     };
 #pragma pack(pop)
-}
\ No newline at end of file
+
+    // Orders grids by their size, colors and block data, which is a total order of distinct grids
+    bool CompareContents(const CompactGrid& a, const CompactGrid& b);
+}
+
+template <>
+class std::hash<sgbust::CompactGrid>
+{
+public:
+    std::size_t operator()(const sgbust::CompactGrid& key) const
+    {
+        // spreads the stored hash over all bits, as the partition of a grid is taken from the upper ones
+        return static_cast<std::size_t>(key.Hash * 0x9E3779B97F4A7C15ull);
+    }
+};
+
+template <>
+class std::equal_to<sgbust::CompactGrid>
+{
+public:
+    constexpr bool operator()(const sgbust::CompactGrid& lhs, const sgbust::CompactGrid& rhs) const
+    {
+        return lhs.Hash == rhs.Hash &&
+            lhs.Width == rhs.Width &&
+            lhs.Height == rhs.Height &&
+            lhs.Colors == rhs.Colors &&
+            std::equal(lhs.Data(), lhs.Data() + lhs.DataLength(), rhs.Data());
+    }
+};
\ No newline at end of file
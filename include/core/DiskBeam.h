@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "core/Beam.h"
+#include "core/BumpArena.h"
+#include "core/CompactGrid.h"
+#include "core/MoveHistory.h"
+#include "core/Scoring.h"
+
+namespace sgbust
+{
+    // The grids of one depth of the beam search, stored in files for beams that do not fit into memory.
+    // While a depth is expanded, the in-memory beam of the next depth is spilled into runs sorted by hash whenever
+    // it grows too large, every one of them free of duplicates. Finish merges the runs, keeping only one of identical grids,
+    // and writes the result into runs sorted by score, which ReadGrids merges again while the beam is expanded.
+    // Grids with equal scores are ordered by their contents, as Beam does with deterministic results.
+    class DiskBeam
+    {
+        class RunReader;
+        class RunWriter;
+
+        std::filesystem::path parentDirectory;
+        // created with the first run and removed with the beam
+        std::optional<std::filesystem::path> directory;
+        std::size_t numRunsCreated = 0;
+        std::vector<std::filesystem::path> hashRuns;
+        std::vector<std::filesystem::path> scoreRuns;
+        std::vector<Beam::Bucket> buckets;
+        std::size_t size = 0;
+        // positions of grids of the last bucket that were dropped, as they are by Beam::Trim
+        std::size_t dropBegin = 0;
+        std::size_t dropEnd = 0;
+        // readers of the runs sorted by score, as a heap with the reader of the next grid on top
+        std::vector<std::unique_ptr<RunReader>> readers;
+        std::vector<RunReader*> readerHeap;
+        // number of grids taken from the readers, including those that were trimmed
+        std::size_t position = 0;
+        std::size_t numRead = 0;
+
+        std::filesystem::path CreateRun();
+        void OpenRuns(const std::vector<std::filesystem::path>& runs, std::size_t count, std::size_t bufferSize, bool byHash,
+            std::vector<std::unique_ptr<RunReader>>& readers, std::vector<RunReader*>& heap);
+        void MergeHashRuns(std::size_t count, std::size_t bufferSize, const std::function<void(CompactGrid&)>& f);
+        void MergeScoreRuns(std::size_t count, std::size_t bufferSize);
+
+    public:
+        explicit DiskBeam(std::filesystem::path directory);
+        DiskBeam(const DiskBeam&) = delete;
+        DiskBeam& operator=(const DiskBeam&) = delete;
+        ~DiskBeam();
+
+        // Writes all merged grids of beam into a new run. Must not be called concurrently with merges of beam.
+        void Spill(const Beam& beam);
+        // Merges the spilled runs into runs sorted by score, using buffers of up to memory bytes. Of identical grids,
+        // the one with the better score is kept together with its history, or with the lesser history if both scores
+        // are equal. With a maximum size, all but the maxSize grids with the best scores are dropped, as with Beam::Trim.
+        // addHistory is called with the histories of all grids that are kept, and possibly of some that are dropped.
+        void Finish(std::size_t memory, std::optional<std::size_t> maxSize, const std::function<void(const MoveLink&)>& addHistory);
+        // Appends the next grids in order of their scores to grids, storing their block data in arena,
+        // until they take up at least maxBytes. Returns false if all grids have been read before.
+        bool ReadGrids(std::vector<CompactGrid>& grids, BumpArena& arena, std::size_t maxBytes);
+        // Removes all runs
+        void Clear();
+
+        // Returns whether any grids were spilled since the last call to Clear
+        bool HasRuns() const { return !hashRuns.empty() || !scoreRuns.empty(); }
+        const std::vector<Beam::Bucket>& GetBuckets() const { return buckets; }
+        std::size_t Size() const { return size; }
+    };
+}
\ No newline at end of file
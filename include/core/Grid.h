@@ -1,10 +1,13 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
 #include <cstddef>
 #include <istream>
+#include <iterator>
 #include <memory>
 #include <random>
+#include <span>
 #include <stdexcept>
 #include <ostream>
 #include <vector>
@@ -37,7 +40,75 @@ namespace sgbust
         bool operator==(const Position& other) const = default;
     };
 
-    using Group = std::vector<Position>;
+    // Handle to a group of blocks stored in a GroupList. Besides the positions of the blocks, it carries
+    // the bounding box of the group so that removing the group does not require it to be recomputed.
+    struct Group
+    {
+        std::span<const Position> Positions;
+        unsigned char Left;
+        unsigned char Right;
+        unsigned char Top;
+        unsigned char Bottom;
+
+        std::size_t size() const { return Positions.size(); }
+        std::span<const Position>::iterator begin() const { return Positions.begin(); }
+        std::span<const Position>::iterator end() const { return Positions.end(); }
+    };
+
+    // Stores all groups of a grid in a single flat array of positions plus a table of group entries,
+    // so that finding the groups of a grid does not require any per-group allocations.
+    class GroupList
+    {
+        struct Entry
+        {
+            unsigned int Offset;
+            unsigned int Size;
+            unsigned char Left;
+            unsigned char Right;
+            unsigned char Top;
+            unsigned char Bottom;
+        };
+
+        std::vector<Position> positions;
+        std::vector<Entry> entries;
+
+        friend struct Grid;
+
+    public:
+        class const_iterator
+        {
+            const GroupList* list = nullptr;
+            std::size_t index = 0;
+
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = Group;
+            using difference_type = std::ptrdiff_t;
+            using pointer = void;
+            using reference = Group;
+
+            const_iterator() = default;
+            const_iterator(const GroupList* list, std::size_t index) : list(list), index(index) {}
+
+            Group operator*() const { return (*list)[index]; }
+            const_iterator& operator++() { index++; return *this; }
+            const_iterator operator++(int) { const_iterator it = *this; index++; return it; }
+            bool operator==(const const_iterator& other) const { return index == other.index; }
+        };
+
+        std::size_t size() const { return entries.size(); }
+        bool empty() const { return entries.empty(); }
+        void clear() { positions.clear(); entries.clear(); }
+
+        Group operator[](std::size_t index) const
+        {
+            const Entry& entry = entries[index];
+            return Group{ std::span(positions.data() + entry.Offset, entry.Size), entry.Left, entry.Right, entry.Top, entry.Bottom };
+        }
+
+        const_iterator begin() const { return const_iterator(this, 0); }
+        const_iterator end() const { return const_iterator(this, size()); }
+    };
 
     struct Grid
     {
@@ -62,9 +133,11 @@ namespace sgbust
         static Grid GenerateRandom(unsigned char width, unsigned char height, unsigned int numColors, Generator& generator);
 
         void Save(std::ostream& stream, unsigned int minGroupSize) const;
-        void GetGroups(std::vector<Group>& groups, unsigned int minGroupSize) const;
+        void GetGroups(GroupList& groups, unsigned int minGroupSize) const;
+        void GetGroups(GroupList& groups, unsigned int minGroupSize, const Grid& oldGrid, const GroupList& oldGroups, std::size_t removedGroupIndex) const;
         bool HasGroups(unsigned int minGroupSize) const;
         void RemoveGroup(const Group& group);
+        void RemoveGroup(const Grid& grid, const Group& group);
         unsigned int GetNumberOfBlocks() const;
         std::array<unsigned int, 8> GetColorCounts() const;
         unsigned int GetNumberOfColors() const;
@@ -81,7 +154,9 @@ namespace sgbust
         void Print(const Group* highlightedGroup = nullptr) const;
 
     private:
-        static void GetAdjacentBlocksRecursive(BlocksSpan blocks, Group& group, unsigned char x, unsigned char y);
+        unsigned int capacity = 0;
+
+        Group FillGroup(Position* positions, unsigned int* visited, unsigned int visitedMark, unsigned char x, unsigned char y, unsigned int maxSize = ~0u) const;
     };
 
     template <typename Generator>
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstdint>
+
+#include "core/Grid.h"
+
+namespace sgbust
+{
+    // Hashes a grid column by column: every column that is not empty is hashed over its blocks from the bottom up
+    // and weighted with a power of a constant by its index among the non-empty columns, and the results are summed.
+    // As removing a group only changes the columns of the group and shifts the columns to the right of it,
+    // the hash of a child can be derived from the hash of its parent by rehashing those columns only.
+    // Equal grids have equal hashes, regardless of the empty columns and rows around their blocks.
+    std::uint32_t HashGrid(const Grid& grid);
+
+    // Returns the hash of newGrid, the result of removing group from oldGrid, given that oldHash is the hash of oldGrid
+    std::uint32_t UpdateGridHash(std::uint32_t oldHash, const Grid& oldGrid, const Group& group, const Grid& newGrid);
+
+    // A second hash of a grid that is computed independently of HashGrid, over all of its blocks.
+    // Like HashGrid, it does not depend on the empty columns and rows around the blocks.
+    std::uint32_t FingerprintGrid(const Grid& grid);
+}
\ No newline at end of file
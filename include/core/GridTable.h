@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+#include "core/BumpArena.h"
+#include "core/CompactGrid.h"
+
+namespace sgbust
+{
+    // An open-addressing hash set of grids, as an alternative to phmap for the partitions of a beam.
+    // Grids are stored as fixed-width CompactGrid records in one flat array with linear probing. Next to it, an array
+    // of tags holds the hash of the grid in every slot, so that probing past other grids only touches the tags.
+    // Slots are claimed with a compare-and-swap on their tag, so several threads may insert at the same time.
+    // The table never grows by itself: Reserve must be called before it holds more than MaxSize grids, and not concurrently with inserts.
+    class GridTable
+    {
+        static constexpr std::uint32_t EmptyTag = 0;
+        // the slot is claimed by an insert whose record is not written yet
+        static constexpr std::uint32_t BusyTag = 1;
+        static constexpr std::size_t MinCapacity = 16;
+        // an empty table is shrunk if it has more than this many times the capacity needed
+        static constexpr std::size_t ShrinkFactor = 4;
+
+        std::unique_ptr<std::atomic<std::uint32_t>[]> tags;
+        std::unique_ptr<std::byte[]> storage;
+        CompactGrid* records = nullptr;
+        std::size_t capacity = 0;
+        unsigned int capacityBits = 0;
+        std::atomic<std::size_t> size = 0;
+
+        // hashes of 0 and 1 are tagged like hashes of 2, they only differ in their slots
+        static std::uint32_t GetTag(const CompactGrid& grid) { return grid.Hash < 2 ? 2 : grid.Hash; }
+        std::size_t GetSlot(const CompactGrid& grid) const;
+        static std::size_t GetCapacity(std::size_t numGrids);
+
+    public:
+        GridTable() = default;
+        GridTable(const GridTable&) = delete;
+        GridTable& operator=(const GridTable&) = delete;
+        ~GridTable();
+
+        // Grows the table such that it holds numGrids grids without exceeding its maximum load factor. Returns whether grids were moved.
+        bool Reserve(std::size_t numGrids);
+        // Frees the storage if the table is empty and far larger than numGrids grids need
+        void Shrink(std::size_t numGrids);
+        // Issues prefetches for the first slot an insert of grid probes
+        void Prefetch(const CompactGrid& grid) const;
+        // Inserts a copy of grid, with its block data stored in arena, unless an identical grid is present already.
+        // Returns the grid in the table and whether it was inserted. The table must hold less than MaxSize grids.
+        std::pair<CompactGrid*, bool> Insert(const CompactGrid& grid, BumpArena& arena);
+        // Removes all grids, but keeps the storage for reuse
+        void Reset();
+        // Removes all grids and frees the storage
+        void Clear();
+
+        std::size_t Size() const { return size.load(std::memory_order_relaxed); }
+        std::size_t Capacity() const { return capacity; }
+        // Number of grids the table holds before it must be grown
+        std::size_t MaxSize() const { return capacity == 0 ? 0 : capacity / 4 * 3 - 1; }
+
+        template <typename F>
+        void ForEach(F f) const
+        {
+            for (std::size_t i = 0; i < capacity; i++)
+                if (tags[i].load(std::memory_order_relaxed) != EmptyTag)
+                    f(records[i]);
+        }
+    };
+}
\ No newline at end of file
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "core/Solution.h"
+
+namespace sgbust
+{
+#pragma pack(push, 1)
+    // Links a beam node to the history entry of its parent and to the move that led from the parent to it
+    struct MoveLink
+    {
+        static constexpr std::uint32_t NoParent = 0xFFFFFFFF;
+
+        std::uint32_t Parent = NoParent;
+        unsigned char Move = 0;
+
+        // Orders links by parent and move, which follows the order of the nodes if their parents were recorded in a fixed order
+        bool operator<(const MoveLink& other) const { return Parent < other.Parent || (Parent == other.Parent && Move < other.Move); }
+    };
+#pragma pack(pop)
+
+    // Records the moves that led to the nodes of the beam as links to their parents, with one table per depth,
+    // so that beam nodes do not need to store their full solution. Entries are only created for nodes that are
+    // expanded and entries that no node of the beam leads to anymore are pruned after every depth.
+    class MoveHistory
+    {
+        std::vector<std::vector<MoveLink>> tables;
+        std::atomic<std::uint32_t> numEntries = 0;
+
+        void Prune(std::vector<char>& live);
+
+    public:
+        void Clear();
+        // Starts a new depth at which at most maxNodes nodes will be expanded
+        void BeginDepth(std::size_t maxNodes);
+        // Records a node expanded at the current depth and returns the index its children refer to as their parent.
+        // May be called concurrently.
+        std::uint32_t Add(const MoveLink& link);
+        // Records a node expanded at the current depth under the given index, which must be less than maxNodes.
+        // May be called concurrently, but not concurrently with the other overload.
+        void Add(std::uint32_t index, const MoveLink& link);
+        void EndDepth();
+        // Removes all entries that none of the links passed to the callback of forEachLink lead to.
+        // The links must belong to children of the nodes expanded at the current depth.
+        template <typename ForEachLink>
+        void Prune(ForEachLink forEachLink);
+        // Returns the moves that lead to a child of a node expanded at the current depth
+        Solution GetSolution(const MoveLink& link) const;
+        std::size_t GetNumberOfEntries() const;
+        // The tables of all depths, as stored by checkpoints between two depths
+        const std::vector<std::vector<MoveLink>>& GetTables() const { return tables; }
+        // Replaces the history with tables taken from GetTables
+        void Restore(std::vector<std::vector<MoveLink>> tables);
+    };
+
+    template <typename ForEachLink>
+    void MoveHistory::Prune(ForEachLink forEachLink)
+    {
+        if (tables.empty())
+            return;
+
+        std::vector<char> live(tables.back().size());
+        forEachLink([&](const MoveLink& link) { live[link.Parent] = 1; });
+        Prune(live);
+    }
+}
\ No newline at end of file
@@ -1,31 +1,55 @@
 #pragma once
 
+#include <algorithm>
 #include <memory>
 #include <string>
 #include <string_view>
 #include <vector>
 
+// Maximum number of steps a Solution stores inline before falling back to the heap
+#ifndef SGBUST_SOLUTION_INLINE_CAPACITY
+#define SGBUST_SOLUTION_INLINE_CAPACITY 14
+#endif
+
 namespace sgbust
 {
+#pragma pack(push, 1)
+    // Short solutions are stored inline, longer ones on the heap. The inline buffer shares its space
+    // with the heap pointer, so at least as many steps as fit into a pointer are always stored inline.
     struct Solution
     {
-        Solution() = default;
+        static constexpr unsigned int InlineCapacity = std::max<unsigned int>(SGBUST_SOLUTION_INLINE_CAPACITY, sizeof(unsigned char*));
+
+        Solution() : length(0) {}
         Solution(std::string_view string);
+        Solution(const std::vector<unsigned char>& steps);
         Solution(const Solution& solution);
-        Solution(Solution&& solution) noexcept = default;
+        Solution(Solution&& solution) noexcept;
         Solution& operator=(const Solution& solution);
-        Solution& operator=(Solution&& solution) noexcept = default;
+        Solution& operator=(Solution&& solution) noexcept;
+        ~Solution();
 
         Solution Append(unsigned char step) const;
         Solution Append(const Solution& solution) const;
         std::string AsString() const;
-        std::vector<unsigned char> AsVector() const { return std::vector(steps.get(), steps.get() + GetLength()); }
-        unsigned int GetLength() const;
-        bool IsEmpty() const { return steps == nullptr; }
+        std::vector<unsigned char> AsVector() const { return std::vector(Steps(), Steps() + length); }
+        unsigned int GetLength() const { return length; }
+        bool IsEmpty() const { return length == 0; }
 
-        unsigned char operator[](unsigned int index) const { return steps[index]; }
+        unsigned char operator[](unsigned int index) const { return Steps()[index]; }
 
     private:
-        std::unique_ptr<unsigned char[]> steps;
+        unsigned short length;
+        union
+        {
+            unsigned char* heapSteps;
+            unsigned char inlineSteps[InlineCapacity];
+        };
+
+        bool IsInline() const { return length <= InlineCapacity; }
+        const unsigned char* Steps() const { return IsInline() ? inlineSteps : heapSteps; }
+        unsigned char* Allocate(unsigned int length);
+        void Free();
     };
+#pragma pack(pop)
 }
\ No newline at end of file
@@ -1,84 +1,164 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cstddef>
-#include <map>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <optional>
-#include <shared_mutex>
 #include <tuple>
+#include <vector>
 
+#include "core/Beam.h"
+#include "core/BumpArena.h"
+#include "core/Checkpoint.h"
 #include "core/CompactGrid.h"
+#include "core/DiskBeam.h"
 #include "core/Grid.h"
+#include "core/MoveHistory.h"
 #include "core/Scoring.h"
-#include "mimalloc.h"
-#include "parallel_hashmap/phmap.h"
-#include "wyhash.h"
-
-template <>
-class std::hash<sgbust::CompactGrid>
-{
-public:
-    std::size_t operator()(const sgbust::CompactGrid& key) const
-    {
-        return wyhash(key.Data.get(), key.DataLength(), 0, _wyp);
-    }
-};
-
-template <>
-class std::equal_to<sgbust::CompactGrid>
-{
-public:
-    constexpr bool operator()(const sgbust::CompactGrid& lhs, const sgbust::CompactGrid& rhs) const
-    {
-        return lhs.Width == rhs.Width &&
-            lhs.Height == rhs.Height &&
-            std::equal(lhs.Data.get(), lhs.Data.get() + lhs.DataLength(), rhs.Data.get());
-    }
-};
+#include "core/TranspositionTable.h"
 
 namespace sgbust
 {
-    using GridHashSet = phmap::parallel_flat_hash_set<CompactGrid, std::hash<CompactGrid>, std::equal_to<CompactGrid>, mi_stl_allocator<CompactGrid>, 4, std::mutex>;
-
     struct SolverResult
     {
         int BestScore;
         Solution BestSolution;
         Grid SolutionGrid;
+        // number of children looked up in the transposition table and of those that were dropped
+        std::uint64_t TranspositionLookups = 0;
+        std::uint64_t TranspositionHits = 0;
+    };
+
+    // A better solution, reported while the search is still running
+    struct SolverImprovement
+    {
+        int Score;
+        sgbust::Solution Solution;
+        unsigned int NumBlocks;
+        // number of steps after the solution prefix
+        unsigned int Depth;
+        // time since the search started
+        std::chrono::milliseconds Elapsed;
     };
 
     class Solver
     {
+        // grids are expanded in rounds of at least MinRoundSize grids,
+        // which add up to about MaxPendingGrids children before they are merged into the beam of the next depth
+        static constexpr std::size_t MinRoundSize = 64;
+        static constexpr std::size_t MaxPendingGrids = 1 << 16;
+        // number of grids a thread takes at once for expanding
+        static constexpr std::size_t ChunkSize = 16;
+        // lower bound of the memory for beams when spilling to disk
+        static constexpr std::size_t MinRunMemory = 1 << 20;
+        // number of depths over which the blocks removed per move are averaged to estimate the depths left with a time limit
+        static constexpr std::size_t DepthEstimateWindow = 4;
+
         unsigned int minGroupSize = 0;
         const Scoring* scoring = nullptr;
         unsigned int depth = 0;
-        std::map<Score, GridHashSet> grids;
+        // the grids of the current and of the next depth
+        std::unique_ptr<Beam> grids = std::make_unique<Beam>();
+        std::unique_ptr<Beam> newGrids = std::make_unique<Beam>();
+        // the grids of the current and of the next depth that were spilled to disk, only used with a spill directory
+        std::unique_ptr<DiskBeam> spilledGrids;
+        std::unique_ptr<DiskBeam> newSpilledGrids;
+        MoveHistory history;
+        // hold the block data of the grids of the current and of the next depth
+        std::unique_ptr<BumpArena> arena = std::make_unique<BumpArena>();
+        std::unique_ptr<BumpArena> newArena = std::make_unique<BumpArena>();
         unsigned int origNumColors = 0;
         Solution solutionPrefix;
         Solution solution;
         std::optional<Grid> solutionGrid;
         std::optional<int> bestScore;
+        MoveLink bestLink;
+        unsigned int bestDepth = 0;
+        bool perfectScoreFound = false;
         unsigned int beamSize = 0;
         unsigned int gridsDiscarded = 0;
-        double multiplier = 0;
-        mutable std::shared_mutex mutex;
+        // memory in use when the search started
+        std::size_t baselineMemory = 0;
+        // number of grids merged into the beam beyond those kept at the last depth
+        std::size_t mergedBeyondKept = 0;
+        // memory taken by pending grids at the last depth
+        std::size_t pendingMemoryUsage = 0;
+        // grids merged into the beam per grid expanded at the last depth, which the beam of the next depth is reserved for
+        double mergedGridsPerGrid = 0.0;
+        std::unique_ptr<TranspositionTable> transpositions;
+        // children looked up in the transposition table and dropped at the current depth, and in total
+        std::atomic<std::uint64_t> transpositionLookups = 0;
+        std::atomic<std::uint64_t> transpositionHits = 0;
+        std::uint64_t totalTranspositionLookups = 0;
+        std::uint64_t totalTranspositionHits = 0;
+        // the grid the search started from, after the solution prefix, and its score
+        std::optional<Grid> startGrid;
+        Score startScore = Score(0);
+        std::chrono::steady_clock::time_point startTime;
+        std::chrono::steady_clock::time_point lastCheckpoint;
+        std::optional<std::chrono::steady_clock::time_point> deadline;
+        bool deadlineReached = false;
+        // with a time limit, what the beam width is chosen from, as measured at the last depths
+        double secondsPerChild = 0.0;
+        double childrenPerGrid = 0.0;
+        double depthsLeft = 0.0;
+        // number of blocks of the leading grid at the last few depths
+        std::deque<unsigned int> recentLeadingGridBlocks;
+        mutable std::mutex mutex;
 
-        void SolveDepth(bool& stop);
-        std::tuple<unsigned int, unsigned int> SolveGrid(const Grid& grid, Score score, std::map<Score, GridHashSet>& newGrids, bool& stop);
-        void CheckSolution(const Grid& grid, Score score, bool& stop);
+        void SolveDepth(std::atomic_bool& stop);
+        std::optional<std::size_t> GetBeamWidth() const;
+        std::optional<std::size_t> GetMemoryBeamWidth() const;
+        std::optional<std::size_t> GetTimeBeamWidth() const;
+        std::size_t GetRunMemory() const;
+        const std::vector<Beam::Bucket>& GetBuckets() const;
+        void CompleteLeadingGrid();
+        void ResumeFromCheckpoint(const Grid& grid);
+        CheckpointState GetCheckpointState() const;
+        std::tuple<unsigned int, unsigned int> SolveGrid(const Grid& grid, std::uint32_t hash, Score score, std::uint32_t historyIndex, unsigned int slot, std::atomic_bool& stop);
+        void CheckSolution(const Grid& grid, Score score, const MoveLink& link, std::atomic_bool& stop);
+        bool IsBetterSolution(int score, const MoveLink& link) const;
+        void ReportImprovement() const;
         void PrintStats(unsigned int depth) const;
-        void PrintProgress(const std::map<Score, GridHashSet>& newGrids, unsigned int gridsSolved, unsigned int newBeamSize, unsigned int newGridsDiscarded) const;
+        void PrintProgress(const Beam& newGrids, unsigned int gridsSolved, unsigned int newBeamSize, unsigned int newGridsDiscarded) const;
 		void ClearProgress() const;
-        void TrimBeam();
 
     public:
         std::optional<unsigned int> MaxBeamSize = std::nullopt;
         std::optional<unsigned int> MaxDepth = std::nullopt;
+        // The beam size is adapted at every depth to what the search can still afford in the time left. Once the time is up,
+        // the search stops and the best grid of its beam is completed greedily.
+        std::optional<std::chrono::milliseconds> TimeLimit = std::nullopt;
+        // in bytes, the beam size is adapted at every depth to stay within it unless beams are spilled to disk
+        std::optional<std::size_t> MaxMemory = std::nullopt;
+        // Beams that do not fit into MaxMemory are spilled to files in this directory, so that the beam size is only
+        // limited by MaxBeamSize and by the disk space. Requires MaxMemory.
+        std::optional<std::filesystem::path> SpillDirectory = std::nullopt;
+        // The search is checkpointed to this file while the first depth is expanded that starts at least CheckpointInterval
+        // after the last checkpoint. A checkpoint holds the grids of that depth, so that the search can be resumed from there.
+        std::optional<std::filesystem::path> CheckpointFile = std::nullopt;
+        std::chrono::seconds CheckpointInterval = std::chrono::minutes(10);
+        // Continues the search from CheckpointFile, which must have been written for the same grid and scoring
+        bool Resume = false;
+        // in bytes, the size of a transposition table of the grids kept in the beams of earlier depths. Children whose grids
+        // were kept at an earlier depth with an equal or better score are dropped, as their moves are searched from there already.
+        // The table is lossy, does not record beams that are spilled to disk and is not part of checkpoints.
+        std::optional<std::size_t> TranspositionTableSize = std::nullopt;
         bool ClearingSolutionsOnly = false;
-        bool TrimmingEnabled = true;
-        double TrimmingSafetyFactor = 1.25;
+        // Makes results independent of the number of threads and of their timing
+        bool Deterministic = false;
         bool Quiet = false;
+        // Called with every solution that becomes the best one, including those with equal scores that replace it
+        // with deterministic results. Calls are made from the thread that found the solution, but never concurrently.
+        std::function<void(const SolverImprovement&)> OnImprovement;
+        HashTableBackend HashTable = HashTableBackend::Phmap;
 
         std::optional<SolverResult> Solve(const Grid& grid, unsigned int minGroupSize, const Scoring& scoring, const Solution& solutionPrefix = {});
     };
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "core/Scoring.h"
+
+namespace sgbust
+{
+    // A bounded, lossy table of grids that were kept in the beams of earlier depths, with the best score each was kept with.
+    // Grids are told apart by their hashes, fingerprints and numbers of blocks only, so two different grids are taken to be
+    // the same with a probability of about 2^-64 per lookup. Entries are stored in buckets of BucketSize entries,
+    // and once the bucket of a grid is full, the entry recorded at the earliest depth is replaced.
+    class TranspositionTable
+    {
+        static constexpr std::size_t BucketSize = 4;
+
+        struct Entry
+        {
+            std::uint32_t Hash = 0;
+            std::uint32_t Fingerprint = 0;
+            std::uint16_t NumBlocks = 0;
+            // zero for empty entries
+            std::uint16_t Depth = 0;
+            sgbust::Score Score = sgbust::Score(0);
+        };
+
+        std::vector<Entry> entries;
+        unsigned int bucketBits;
+
+        // index of the first entry of the bucket of a grid
+        std::size_t GetBucket(std::uint32_t hash) const;
+
+    public:
+        // Creates a table that takes up at most size bytes, but at least two buckets
+        explicit TranspositionTable(std::size_t size);
+
+        // Returns whether the grid was recorded with an equal or better score
+        bool Contains(std::uint32_t hash, std::uint32_t fingerprint, unsigned int numBlocks, const Score& score) const;
+        // Records that the grid was kept at the given depth, which must be at least one
+        void Store(std::uint32_t hash, std::uint32_t fingerprint, unsigned int numBlocks, const Score& score, unsigned int depth);
+    };
+}
\ No newline at end of file
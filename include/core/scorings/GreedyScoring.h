@@ -13,7 +13,7 @@ namespace sgbust
     public:
         GreedyScoring(GroupSizeFunc groupScore, int clearanceBonus = 0, LeftoverPenaltyFunc leftoverPenalty = nullptr);
         Score CreateScore(const Grid& grid, unsigned int minGroupSize) const override;
-        Score RemoveGroup(const Score& oldScore, const Grid& oldGrid, const Group& group, const Grid& newGrid, unsigned int minGroupSize) const override;
+        Score RemoveGroup(const Score& oldScore, const Grid& oldGrid, const GroupList& oldGroups, std::size_t groupIndex, const Grid& newGrid, unsigned int minGroupSize) const override;
         bool IsPerfectScore(const Score& score) const override;
     };
 }
\ No newline at end of file
@@ -8,7 +8,7 @@ namespace sgbust
     {
     public:
         Score CreateScore(const Grid& grid, unsigned int minGroupSize) const override;
-        Score RemoveGroup(const Score& oldScore, const Grid& oldGrid, const Group& group, const Grid& newGrid, unsigned int minGroupSize) const override;
+        Score RemoveGroup(const Score& oldScore, const Grid& oldGrid, const GroupList& oldGroups, std::size_t groupIndex, const Grid& newGrid, unsigned int minGroupSize) const override;
         bool IsPerfectScore(const Score& score) const override;
     };
 }
\ No newline at end of file
@@ -32,11 +32,42 @@ void RunCommand(const SolveCLIOptions& cliOptions)
 
     solver.MaxBeamSize = cliOptions.MaxBeamSize;
     solver.MaxDepth = cliOptions.MaxDepth;
+    if (cliOptions.TimeLimit.has_value())
+        solver.TimeLimit = std::chrono::milliseconds(static_cast<long long>(*cliOptions.TimeLimit * 1000));
+    if (cliOptions.MaxMemory.has_value())
+        solver.MaxMemory = static_cast<std::size_t>(*cliOptions.MaxMemory) * 1024 * 1024;
+    if (cliOptions.SpillDirectory.has_value())
+        solver.SpillDirectory = *cliOptions.SpillDirectory;
+    if (cliOptions.CheckpointFile.has_value())
+        solver.CheckpointFile = *cliOptions.CheckpointFile;
+    solver.CheckpointInterval = std::chrono::minutes(cliOptions.CheckpointInterval);
+    solver.Resume = cliOptions.Resume;
     solver.ClearingSolutionsOnly = cliOptions.ClearingSolutionsOnly;
-    solver.TrimmingEnabled = cliOptions.TrimmingEnabled;
-    solver.TrimmingSafetyFactor = cliOptions.TrimmingSafetyFactor;
+    solver.HashTable = cliOptions.HashTable;
+    if (cliOptions.TranspositionTableSize.has_value())
+        solver.TranspositionTableSize = static_cast<std::size_t>(*cliOptions.TranspositionTableSize) * 1024 * 1024;
+    solver.Deterministic = cliOptions.Deterministic;
     solver.Quiet = cliOptions.Quiet;
 
+    std::ofstream improvementsFile;
+    if (cliOptions.EmitImprovements.has_value())
+    {
+        std::ostream* improvements = &std::cout;
+        if (*cliOptions.EmitImprovements != "-")
+        {
+            improvementsFile.open(*cliOptions.EmitImprovements);
+            if (!improvementsFile)
+                throw std::runtime_error(std::format("Could not create file {}", *cliOptions.EmitImprovements));
+            improvements = &improvementsFile;
+        }
+
+        // every line is flushed right away, so that it can be picked up while the search goes on
+        solver.OnImprovement = [improvements](const sgbust::SolverImprovement& improvement) {
+            *improvements << std::format("{{\"score\":{},\"blocks\":{},\"steps\":{},\"depth\":{},\"elapsed_ms\":{},\"solution\":\"{}\"}}",
+                improvement.Score, improvement.NumBlocks, improvement.Solution.GetLength(), improvement.Depth, improvement.Elapsed.count(), improvement.Solution.AsString()) << std::endl;
+        };
+    }
+
     auto startTime = std::chrono::steady_clock::now();
 
     std::optional<sgbust::SolverResult> solverResult = solver.Solve(grid, minGroupSize, *cliOptions.ScoringOptions.Scoring, sgbust::Solution(cliOptions.SolutionPrefix));
@@ -48,6 +79,9 @@ void RunCommand(const SolveCLIOptions& cliOptions)
     {
         std::cout << std::endl;
         std::cout << "Elapsed: " << std::format("{:%T}", elapsedMilliseconds) << std::endl;
+        if (solverResult.has_value() && solver.TranspositionTableSize.has_value())
+            std::cout << std::format("Transposition hits: {} of {} children ({:.2f}%)", solverResult->TranspositionHits, solverResult->TranspositionLookups,
+                solverResult->TranspositionLookups != 0 ? solverResult->TranspositionHits * 100.0 / solverResult->TranspositionLookups : 0.0) << std::endl;
         if (solverResult.has_value())
         {
             std::cout << "Best solution (score: " << solverResult->BestScore
@@ -120,13 +154,14 @@ void RunCommand(const ShowCLIOptions& cliOptions)
         for (unsigned int i = 0; i < solution.GetLength(); i++)
         {
             unsigned char step = solution[i];
-            std::vector<sgbust::Group> groups;
+            sgbust::GroupList groups;
             bg.GetGroups(groups, minGroupSize);
             if (step >= groups.size())
                 throw std::invalid_argument("Solution string is not valid for this grid");
-            std::cout << (i + 1) << ". " << groups[step].size() << " block" << pluralS(groups[step].size()) << std::endl;
-            bg.Print(&groups[step]);
-            bg.RemoveGroup(groups[step]);
+            sgbust::Group group = groups[step];
+            std::cout << (i + 1) << ". " << group.size() << " block" << pluralS(group.size()) << std::endl;
+            bg.Print(&group);
+            bg.RemoveGroup(group);
         }
 
 		std::cout << "Final grid:" << std::endl;
@@ -155,6 +190,10 @@ void RunCommand(const BenchmarkCLIOptions& cliOptions)
     sgbust::Solver solver;
 
     solver.MaxBeamSize = cliOptions.MaxBeamSize;
+    solver.HashTable = cliOptions.HashTable;
+    if (cliOptions.TranspositionTableSize.has_value())
+        solver.TranspositionTableSize = static_cast<std::size_t>(*cliOptions.TranspositionTableSize) * 1024 * 1024;
+    solver.Deterministic = cliOptions.Deterministic;
     solver.Quiet = true;
 
     std::cout << "Press Ctrl+C to cancel." << std::endl;
@@ -163,13 +202,16 @@ void RunCommand(const BenchmarkCLIOptions& cliOptions)
     unsigned long long gridsCleared = 0;
     long long bestScoreSum = 0;
     unsigned long long blocksRemainingSum = 0;
+    unsigned long long transpositionLookups = 0;
+    unsigned long long transpositionHits = 0;
+    bool printTranspositions = solver.TranspositionTableSize.has_value();
     auto startTime = std::chrono::steady_clock::now();
     std::optional<std::chrono::steady_clock::time_point> lastStatsPrinted;
     constexpr std::chrono::duration<double> RefreshInterval = std::chrono::seconds(1);
 
     auto printStats = [&]() {
         if (lastStatsPrinted.has_value())
-            std::cout << "\x1B[5F"; // move cursor to the beginning of the line five lines up
+            std::cout << (printTranspositions ? "\x1B[6F" : "\x1B[5F"); // move cursor to the beginning of the first line
 
         auto elapsed = std::chrono::steady_clock::now() - startTime;
         auto elapsedMilliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(elapsed);
@@ -180,6 +222,7 @@ void RunCommand(const BenchmarkCLIOptions& cliOptions)
         double gridsClearedPercent = zeroIfNaN(static_cast<double>(gridsCleared) / gridsSolved * 100);
         double averageScore = zeroIfNaN(static_cast<double>(bestScoreSum) / gridsSolved);
         double averageBlocksRemaining = zeroIfNaN(static_cast<double>(blocksRemainingSum) / gridsSolved);
+        double transpositionHitsPercent = zeroIfNaN(static_cast<double>(transpositionHits) / transpositionLookups * 100);
 
         std::cout << std::fixed << std::setprecision(2);
         std::cout << "Elapsed: " << std::format("{:%T}", elapsedMilliseconds) << "\x1B[K\n";
@@ -187,6 +230,8 @@ void RunCommand(const BenchmarkCLIOptions& cliOptions)
         std::cout << "Grids cleared: " << gridsCleared << " (" << gridsClearedPercent << "%)\x1B[K\n";
         std::cout << "Average score: " << averageScore << "\x1B[K\n";
         std::cout << "Average number of blocks remaining: " << averageBlocksRemaining << "\x1B[K\n";
+        if (printTranspositions)
+            std::cout << "Transposition hits: " << transpositionHits << " (" << transpositionHitsPercent << "%)\x1B[K\n";
         std::cout << "Speed: " << gridsPerSecond << " grids/second (" << secondsPerGrid << " seconds/grid)\x1B[K" << std::flush;
         };
 
@@ -205,6 +250,8 @@ void RunCommand(const BenchmarkCLIOptions& cliOptions)
             if (result->SolutionGrid.IsEmpty())
                 gridsCleared++;
             blocksRemainingSum += result->SolutionGrid.GetNumberOfBlocks();
+            transpositionLookups += result->TranspositionLookups;
+            transpositionHits += result->TranspositionHits;
 
             auto now = std::chrono::steady_clock::now();
             if (!lastStatsPrinted.has_value() || now - *lastStatsPrinted >= RefreshInterval)
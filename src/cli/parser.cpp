@@ -1,6 +1,7 @@
 #include "cli/parser.h"
 
 #include <functional>
+#include <iostream>
 #include <unordered_map>
 
 #include "CLI/CLI.hpp"
@@ -14,6 +15,11 @@ static const std::unordered_map<std::string, ScoringType> ScoringTypeStrings{
     { "num-blocks-not-in-groups", ScoringType::NumBlocksNotInGroups }
 };
 
+static const std::unordered_map<std::string, sgbust::HashTableBackend> HashTableBackendStrings{
+    { "phmap", sgbust::HashTableBackend::Phmap },
+    { "open-addressing", sgbust::HashTableBackend::OpenAddressing }
+};
+
 static void AddScoringOptions(CLI::App* command, ScoringOptions& scoringOptions)
 {
     command->add_option("--scoring", scoringOptions.ScoringType, "Type of scoring")->transform(CLI::CheckedTransformer(ScoringTypeStrings, CLI::ignore_case));
@@ -77,15 +83,33 @@ std::variant<CLIOptions, int> ParseArgs(int argc, const char* argv[])
     solveCommand->add_option("grid-file", solveCliOptions.GridFile, "Bloc Grid File (.bgf)")->required()->check(CLI::ExistingFile);
     AddScoringOptions(solveCommand, solveCliOptions.ScoringOptions);
     solveCommand->add_option("--prefix", solveCliOptions.SolutionPrefix, "Solution prefix");
-    solveCommand->add_option("-s,--max-beam-size", solveCliOptions.MaxBeamSize, "Maximum beam size");
+    solveCommand->add_option("-s,--max-beam-size", solveCliOptions.MaxBeamSize, "Number of grids kept and expanded at each step. Earlier versions limited the number of grids generated at each step instead, so values used with them should be divided by the typical number of groups per grid.");
     solveCommand->add_option("-d,--max-depth", solveCliOptions.MaxDepth, "Maximum search depth");
+    solveCommand->add_option("--time-limit", solveCliOptions.TimeLimit, "Time limit in seconds. The beam size is adapted at every depth to finish the search in time. Once the time is up, the best grid of the beam is completed greedily and the best solution found is reported.")->check(CLI::PositiveNumber);
+    CLI::Option* maxMemoryOption = solveCommand->add_option("--max-memory", solveCliOptions.MaxMemory, "Maximum memory usage in MB. The beam size is adapted at every depth to stay within it, unless --spill-dir is specified.")->check(CLI::PositiveNumber);
+    solveCommand->add_option("--spill-dir", solveCliOptions.SpillDirectory, "Directory to spill beams to that do not fit into --max-memory, so that the beam size is only limited by disk space")->needs(maxMemoryOption);
+    CLI::Option* checkpointOption = solveCommand->add_option("--checkpoint", solveCliOptions.CheckpointFile, "File to periodically save the state of the search to, so that it can be resumed with --resume");
+    solveCommand->add_option("--checkpoint-interval", solveCliOptions.CheckpointInterval, "Minimum number of minutes between two checkpoints (default: 10)")->check(CLI::PositiveNumber)->needs(checkpointOption);
+    solveCommand->add_option("--emit-improvements", solveCliOptions.EmitImprovements, "File to write every better solution to as soon as it is found, as one JSON object per line. Use - for the standard output.");
+    CLI::Option* resumeOption = solveCommand->add_flag("--resume", solveCliOptions.Resume, "Resume the search from the file given by --checkpoint")->needs(checkpointOption);
     solveCommand->add_flag("--clearing-only", solveCliOptions.ClearingSolutionsOnly, "Only report solutions that clear the grid. Can be combined with --max-depth to search for solutions that clear the grid within the specified number of steps.");
-    solveCommand->add_flag("!--no-trim", solveCliOptions.TrimmingEnabled, "Disable beam trimming");
-    solveCommand->add_option("--trimming-safety-factor", solveCliOptions.TrimmingSafetyFactor, "Trimming safety factor");
+    solveCommand->add_option("--hash-table", solveCliOptions.HashTable, "Hash table that deduplicates the grids of the beam (phmap or open-addressing)")->transform(CLI::CheckedTransformer(HashTableBackendStrings, CLI::ignore_case));
+    solveCommand->add_option("--transposition-table", solveCliOptions.TranspositionTableSize, "Size in MB of a table of the grids kept at earlier depths. Grids that were kept at an earlier depth with an equal or better score are not searched again. Cannot be combined with --resume, as the table is not stored in checkpoints.")->check(CLI::PositiveNumber)->excludes(resumeOption);
+    solveCommand->add_flag("--deterministic", solveCliOptions.Deterministic, "Produce identical results regardless of the number of threads");
     solveCommand->add_flag("-q,--quiet", solveCliOptions.Quiet, "Quiet mode");
+    // the beam is always trimmed to exactly --max-beam-size now, the former trimming options are only accepted so that existing command lines keep working
+    bool noTrim = false;
+    std::optional<double> trimmingSafetyFactor;
+    solveCommand->add_flag("--no-trim", noTrim, "Deprecated, has no effect");
+    solveCommand->add_option("--trimming-safety-factor", trimmingSafetyFactor, "Deprecated, has no effect");
     solveCommand->callback([&] {
         ValidateAndSetScoring(solveCliOptions.ScoringOptions);
 
+        if (noTrim)
+            std::cerr << "Warning: --no-trim is deprecated and has no effect" << std::endl;
+        if (trimmingSafetyFactor.has_value())
+            std::cerr << "Warning: --trimming-safety-factor is deprecated and has no effect" << std::endl;
+
         cliOptions = std::move(solveCliOptions);
         });
 
@@ -118,7 +142,10 @@ std::variant<CLIOptions, int> ParseArgs(int argc, const char* argv[])
     benchmarkCommand->add_option("--min-group-size", benchmarkCliOptions.MinGroupSize, "Minimal group size")->check(CLI::Range(1, 255 * 255))->required();
     benchmarkCommand->add_option("--num-grids", benchmarkCliOptions.NumGrids, "Number of grids to generate and solve");
     AddScoringOptions(benchmarkCommand, benchmarkCliOptions.ScoringOptions);
-    benchmarkCommand->add_option("--max-beam-size", benchmarkCliOptions.MaxBeamSize, "Maximum beam size");
+    benchmarkCommand->add_option("--max-beam-size", benchmarkCliOptions.MaxBeamSize, "Number of grids kept and expanded at each step");
+    benchmarkCommand->add_option("--hash-table", benchmarkCliOptions.HashTable, "Hash table that deduplicates the grids of the beam (phmap or open-addressing)")->transform(CLI::CheckedTransformer(HashTableBackendStrings, CLI::ignore_case));
+    benchmarkCommand->add_option("--transposition-table", benchmarkCliOptions.TranspositionTableSize, "Size in MB of a table of the grids kept at earlier depths")->check(CLI::PositiveNumber);
+    benchmarkCommand->add_flag("--deterministic", benchmarkCliOptions.Deterministic, "Produce identical results regardless of the number of threads");
     benchmarkCommand->callback([&]() { 
         ValidateAndSetScoring(benchmarkCliOptions.ScoringOptions);
         
@@ -0,0 +1,399 @@
+#include "core/Beam.h"
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <execution>
+#include <functional>
+#include <limits>
+#include <numeric>
+#include <tuple>
+#include <utility>
+
+namespace
+{
+    std::atomic<std::uint64_t> nextGeneration = 1;
+}
+
+namespace sgbust
+{
+    Beam::Beam() : generation(nextGeneration++)
+    {
+    }
+
+    Beam::PendingBuffer& Beam::GetPendingBuffer()
+    {
+        // the buffer the calling thread used last, valid if its generation matches the one of the beam
+        static thread_local std::uint64_t cachedGeneration = 0;
+        static thread_local PendingBuffer* cachedBuffer = nullptr;
+
+        if (cachedGeneration != generation)
+        {
+            std::scoped_lock lock(mutex);
+
+            std::thread::id threadId = std::this_thread::get_id();
+            auto it = std::find_if(pendingBuffers.begin(), pendingBuffers.end(), [&](const auto& buffer) { return buffer->Owner == threadId; });
+            if (it == pendingBuffers.end())
+            {
+                it = pendingBuffers.insert(pendingBuffers.end(), std::make_unique<PendingBuffer>());
+                (*it)->Owner = threadId;
+                (*it)->Next = firstPendingBuffer.load(std::memory_order_relaxed);
+                firstPendingBuffer.store(it->get(), std::memory_order_release);
+            }
+
+            cachedGeneration = generation;
+            cachedBuffer = it->get();
+        }
+
+        return *cachedBuffer;
+    }
+
+    void Beam::Add(const Grid& grid, std::uint32_t gridHash, const Score& score, const MoveLink& history, unsigned int slot)
+    {
+        CompactGrid compactGrid(grid, gridHash, score, history, pendingArenas[slot]);
+
+        std::size_t hash = partitions[0].hash(compactGrid);
+        std::size_t partition = hash >> (std::numeric_limits<std::size_t>::digits - PartitionBits);
+
+        GetPendingBuffer().Slots[slot][partition].push_back(PendingGrid{ hash, std::move(compactGrid) });
+    }
+
+    std::size_t Beam::Merge(BumpArena& arena, unsigned int slot)
+    {
+        std::size_t numInserted = std::transform_reduce(std::execution::par, partitions.begin(), partitions.end(), std::size_t(0), std::plus<>(), [&](GridHashSet& partition) {
+            return MergePartition(&partition - partitions.data(), arena, slot);
+            });
+
+        FinishMerge(slot);
+
+        return numInserted;
+    }
+
+    std::size_t Beam::MergePartition(std::size_t index, BumpArena& arena, unsigned int slot)
+    {
+        bool keepHistogram = maxSize.has_value();
+        bool useTable = hashTable == HashTableBackend::OpenAddressing;
+        std::size_t numInserted = 0;
+        std::size_t numPartitionRehashes = 0;
+        GridHashSet& partition = partitions[index];
+        GridTable& table = tables[index];
+        std::map<std::int64_t, std::ptrdiff_t>& changes = histogramChanges[index];
+
+        std::scoped_lock lock(partitionMutexes[index]);
+
+        std::size_t capacity = partition.capacity();
+
+        for (PendingBuffer* buffer = firstPendingBuffer.load(std::memory_order_acquire); buffer != nullptr; buffer = buffer->Next)
+        {
+            std::vector<PendingGrid>& pendingGrids = buffer->Slots[slot][index];
+
+            // The grids are inserted in the order they were buffered, with the slots of the grid a few positions ahead
+            // being prefetched, so that the cache misses of several inserts overlap. Mismatching grids in a slot are
+            // mostly told apart by their stored hashes, without reading their block data.
+            for (std::size_t i = 0; i < pendingGrids.size(); i++)
+            {
+                if (prefetchDistance != 0 && i + prefetchDistance < pendingGrids.size())
+                {
+                    if (useTable)
+                        table.Prefetch(pendingGrids[i + prefetchDistance].Grid);
+                    else
+                        partition.prefetch_hash(pendingGrids[i + prefetchDistance].Hash);
+                }
+
+                // A table grows only once it is full, and then for the rest of the buffer at once, so that duplicate grids
+                // do not make it grow. This thread holds the lock of the partition and is the only one inserting.
+                if (useTable && table.Size() >= table.MaxSize() && table.Reserve(table.Size() + pendingGrids.size() - i))
+                    numPartitionRehashes++;
+
+                const PendingGrid& pending = pendingGrids[i];
+                CompactGrid* grid;
+                bool inserted = false;
+
+                if (useTable)
+                    std::tie(grid, inserted) = table.Insert(pending.Grid, arena);
+                else
+                {
+                    auto it = partition.lazy_emplace_with_hash(pending.Grid, pending.Hash, [&](const auto& constructor) {
+                        constructor(pending.Grid, arena);
+                        inserted = true;
+                        });
+                    // score and history are not part of the identity of a grid, so they can be changed in place
+                    grid = const_cast<CompactGrid*>(&*it);
+                }
+
+                if (inserted)
+                {
+                    numInserted++;
+                    if (keepHistogram)
+                        changes[GetBin(pending.Grid.Score)]++;
+
+                    // phmap grows while grids are inserted, a first allocation does not count as a rehash
+                    if (!useTable && partition.capacity() != capacity)
+                    {
+                        if (capacity != 0)
+                            numPartitionRehashes++;
+                        capacity = partition.capacity();
+                    }
+                }
+                else if (pending.Grid.Score < grid->Score || (!(grid->Score < pending.Grid.Score) && pending.Grid.History < grid->History))
+                {
+                    if (keepHistogram)
+                    {
+                        changes[GetBin(grid->Score)]--;
+                        changes[GetBin(pending.Grid.Score)]++;
+                    }
+
+                    grid->Score = pending.Grid.Score;
+                    grid->History = pending.Grid.History;
+                }
+            }
+
+            pendingGrids.clear();
+        }
+
+        if (numPartitionRehashes != 0)
+            numRehashes.fetch_add(numPartitionRehashes, std::memory_order_relaxed);
+
+        return numInserted;
+    }
+
+    void Beam::FinishMerge(unsigned int slot)
+    {
+        pendingArenas[slot].Reset();
+
+        if (maxSize.has_value())
+            UpdateAdmissionLimit();
+    }
+
+    void Beam::UpdateAdmissionLimit()
+    {
+        for (std::map<std::int64_t, std::ptrdiff_t>& changes : histogramChanges)
+        {
+            for (auto [bin, change] : changes)
+            {
+                std::size_t& count = histogram[bin];
+                count += change;
+                if (count == 0)
+                    histogram.erase(bin);
+            }
+
+            changes.clear();
+        }
+
+        // the limit is the bin in which the grids reach the maximum size, grids in worse bins cannot make it into the beam.
+        // A limit stays valid after the grids it was derived from are dropped, as they are kept elsewhere.
+        std::size_t accumulatedCount = 0;
+        std::int64_t limit = std::numeric_limits<std::int64_t>::max();
+
+        for (auto [bin, count] : histogram)
+        {
+            accumulatedCount += count;
+            if (accumulatedCount >= *maxSize)
+            {
+                limit = bin;
+                break;
+            }
+        }
+
+        admissionLimit.store(std::min(limit, admissionLimit.load(std::memory_order_relaxed)), std::memory_order_relaxed);
+    }
+
+    void Beam::Sort()
+    {
+        sortedGrids.clear();
+        buckets.clear();
+        bytesPerGrid = 0.0;
+
+        int minValue = INT_MAX;
+        int maxValue = INT_MIN;
+        bool integerObjectives = true;
+        std::size_t numGrids = 0;
+        std::size_t memoryUsage = 0;
+
+        ForEach([&](const CompactGrid& grid) {
+            minValue = std::min(minValue, grid.Score.Value);
+            maxValue = std::max(maxValue, grid.Score.Value);
+            integerObjectives = integerObjectives && grid.Score.Objective == static_cast<float>(grid.Score.Value);
+            numGrids++;
+            if (grid.DataLength() > CompactGrid::InlineCapacity)
+                memoryUsage += grid.DataLength();
+            });
+
+        if (numGrids == 0)
+            return;
+
+        memoryUsage += GetMergedMemoryUsage();
+        bytesPerGrid = static_cast<double>(memoryUsage) / numGrids;
+
+        std::size_t numValues = static_cast<std::size_t>(static_cast<long long>(maxValue) - minValue + 1);
+
+        sortedGrids.resize(numGrids);
+
+        if (integerObjectives && numValues <= std::max(numGrids, MinFlatBucketRange))
+        {
+            // counting sort by score offset, grids with the same score stay in hash set order
+            std::vector<std::size_t> offsets(numValues + 1);
+            ForEach([&](const CompactGrid& grid) { offsets[grid.Score.Value - minValue + 1]++; });
+            std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+            for (std::size_t i = 0; i < numValues; i++)
+                if (offsets[i] != offsets[i + 1])
+                    buckets.push_back(Bucket{ Score(minValue + static_cast<int>(i)), offsets[i], offsets[i + 1] });
+
+            ForEach([&](const CompactGrid& grid) { sortedGrids[offsets[grid.Score.Value - minValue]++] = &grid; });
+
+            if (deterministic)
+                std::for_each(std::execution::par, buckets.begin(), buckets.end(), [&](const Bucket& bucket) {
+                    std::sort(sortedGrids.begin() + bucket.Begin, sortedGrids.begin() + bucket.End, [](const CompactGrid* a, const CompactGrid* b) {
+                        return CompareContents(*a, *b);
+                        });
+                    });
+        }
+        else
+        {
+            // objectives that are not integers, as with PotentialScoring, or very wide score ranges
+            std::size_t i = 0;
+            ForEach([&](const CompactGrid& grid) { sortedGrids[i++] = &grid; });
+            std::stable_sort(sortedGrids.begin(), sortedGrids.end(), [&](const CompactGrid* a, const CompactGrid* b) {
+                if (a->Score < b->Score)
+                    return true;
+                return deterministic && !(b->Score < a->Score) && CompareContents(*a, *b);
+                });
+
+            for (std::size_t begin = 0, end; begin < sortedGrids.size(); begin = end)
+            {
+                const Score& score = sortedGrids[begin]->Score;
+                end = begin + 1;
+                while (end < sortedGrids.size() && !(score < sortedGrids[end]->Score))
+                    end++;
+                buckets.push_back(Bucket{ score, begin, end });
+            }
+        }
+    }
+
+    void Beam::Trim(std::size_t size)
+    {
+        if (size >= sortedGrids.size())
+            return;
+
+        std::size_t accumulatedSize = 0;
+
+        auto it = buckets.begin();
+        for (; ; it++)
+        {
+            accumulatedSize += it->End - it->Begin;
+            if (accumulatedSize >= size)
+                break;
+        }
+
+        // grids are dropped from the beginning of the last bucket that is kept
+        std::size_t numDropped = accumulatedSize - size;
+        sortedGrids.erase(sortedGrids.begin() + it->Begin, sortedGrids.begin() + it->Begin + numDropped);
+        it->End -= numDropped;
+
+        buckets.erase(it + 1, buckets.end());
+        sortedGrids.resize(size);
+    }
+
+    std::size_t Beam::MergedSize() const
+    {
+        std::size_t size = 0;
+        for (std::size_t i = 0; i < NumPartitions; i++)
+            size += hashTable == HashTableBackend::OpenAddressing ? tables[i].Size() : partitions[i].size();
+        return size;
+    }
+
+    void Beam::Reserve(std::size_t numGrids)
+    {
+        // grids are spread evenly over the partitions by their hashes
+        std::size_t numGridsPerPartition = numGrids / NumPartitions + 1;
+
+        if (hashTable == HashTableBackend::OpenAddressing)
+            std::for_each(std::execution::par, tables.begin(), tables.end(), [&](GridTable& table) {
+                table.Shrink(numGridsPerPartition);
+                if (table.Reserve(numGridsPerPartition))
+                    numRehashes.fetch_add(1, std::memory_order_relaxed);
+                });
+        else
+            std::for_each(std::execution::par, partitions.begin(), partitions.end(), [&](GridHashSet& partition) {
+                std::size_t capacity = partition.capacity();
+                partition.reserve(numGridsPerPartition);
+                if (partition.size() != 0 && partition.capacity() != capacity)
+                    numRehashes.fetch_add(1, std::memory_order_relaxed);
+                });
+    }
+
+    std::size_t Beam::GetMergedMemoryUsage() const
+    {
+        // every slot of a hash set takes one control byte besides the grid itself, or a tag with GridTable
+        std::size_t size = 0;
+        for (std::size_t i = 0; i < NumPartitions; i++)
+        {
+            if (hashTable == HashTableBackend::OpenAddressing)
+                size += tables[i].Capacity() * (sizeof(CompactGrid) + sizeof(std::uint32_t));
+            else
+                size += partitions[i].capacity() * (sizeof(CompactGrid) + 1);
+        }
+        return size;
+    }
+
+    std::size_t Beam::GetPendingMemoryUsage() const
+    {
+        std::size_t size = 0;
+
+        for (const std::unique_ptr<PendingBuffer>& buffer : pendingBuffers)
+            for (const auto& slot : buffer->Slots)
+                for (const std::vector<PendingGrid>& pendingGrids : slot)
+                    size += pendingGrids.capacity() * sizeof(PendingGrid);
+
+        for (const BumpArena& pendingArena : pendingArenas)
+            size += pendingArena.GetMemoryUsage();
+
+        return size;
+    }
+
+    void Beam::ReleasePendingMemory()
+    {
+        for (const std::unique_ptr<PendingBuffer>& buffer : pendingBuffers)
+            for (auto& slot : buffer->Slots)
+                for (std::vector<PendingGrid>& pendingGrids : slot)
+                    pendingGrids.shrink_to_fit();
+
+        for (BumpArena& pendingArena : pendingArenas)
+            pendingArena.Clear();
+    }
+
+    void Beam::DropMerged()
+    {
+        for (std::size_t i = 0; i < NumPartitions; i++)
+        {
+            std::scoped_lock lock(partitionMutexes[i]);
+            partitions[i].clear();
+            tables[i].Clear();
+        }
+
+        histogram.clear();
+    }
+
+    void Beam::Clear()
+    {
+        // phmap frees all but small hash sets, while tables keep their storage for the next depth
+        for (GridHashSet& partition : partitions)
+            partition.clear();
+        std::for_each(std::execution::par, tables.begin(), tables.end(), [](GridTable& table) { table.Reset(); });
+        numRehashes.store(0, std::memory_order_relaxed);
+
+        for (const std::unique_ptr<PendingBuffer>& buffer : pendingBuffers)
+            for (auto& slot : buffer->Slots)
+                for (std::vector<PendingGrid>& pendingGrids : slot)
+                    pendingGrids.clear();
+
+        for (BumpArena& pendingArena : pendingArenas)
+            pendingArena.Reset();
+        sortedGrids.clear();
+        buckets.clear();
+        bytesPerGrid = 0.0;
+        histogram.clear();
+        admissionLimit.store(std::numeric_limits<std::int64_t>::max(), std::memory_order_relaxed);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,829 @@
+#include "core/BlockPacking.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define SGBUST_X64
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define SGBUST_TARGET(features) __attribute__((target(features)))
+#else
+#define SGBUST_TARGET(features)
+#endif
+
+namespace
+{
+    using sgbust::Block;
+    using sgbust::PackingKernel;
+
+    // Within each group of 8 blocks, blocks 0, 1, 3, 4, 6 and 7 are stored at bit 3 * i of the little-endian 24-bit group,
+    // while the bits of blocks 2 and 5 are rotated by one position (right and left, respectively) to fit the original byte-wise layout.
+
+    std::size_t GetDataLength(std::size_t numBlocks)
+    {
+        return (numBlocks * 3 + 7) / 8;
+    }
+
+    void PackGroup(const Block* blocks, std::byte* b)
+    {
+        b[0] = static_cast<std::byte>(blocks[0]);
+        b[0] |= static_cast<std::byte>(blocks[1]) << 3;
+        b[0] |= (static_cast<std::byte>(blocks[2]) & std::byte{ 0b110 }) << 5;
+        b[1] = static_cast<std::byte>(blocks[2]) & std::byte{ 0b001 };
+        b[1] |= static_cast<std::byte>(blocks[3]) << 1;
+        b[1] |= static_cast<std::byte>(blocks[4]) << 4;
+        b[1] |= (static_cast<std::byte>(blocks[5]) & std::byte{ 0b100 }) << 5;
+        b[2] = static_cast<std::byte>(blocks[5]) & std::byte{ 0b011 };
+        b[2] |= static_cast<std::byte>(blocks[6]) << 2;
+        b[2] |= static_cast<std::byte>(blocks[7]) << 5;
+    }
+
+    void UnpackGroup(const std::byte* b, Block* blocks)
+    {
+        blocks[0] = static_cast<Block>(b[0] & std::byte{ 0b111 });
+        blocks[1] = static_cast<Block>((b[0] >> 3) & std::byte{ 0b111 });
+        blocks[2] = static_cast<Block>(((b[0] >> 5) & std::byte{ 0b110 }) | (b[1] & std::byte{ 0b001 }));
+        blocks[3] = static_cast<Block>((b[1] >> 1) & std::byte{ 0b111 });
+        blocks[4] = static_cast<Block>((b[1] >> 4) & std::byte{ 0b111 });
+        blocks[5] = static_cast<Block>(((b[1] >> 5) & std::byte{ 0b100 }) | (b[2] & std::byte{ 0b011 }));
+        blocks[6] = static_cast<Block>((b[2] >> 2) & std::byte{ 0b111 });
+        blocks[7] = static_cast<Block>((b[2] >> 5) & std::byte{ 0b111 });
+    }
+
+    void PackBlocksScalar(const Block* blocks, std::size_t numBlocks, std::byte* data)
+    {
+        std::size_t i = 0;
+        for (; i + 8 <= numBlocks; i += 8, data += 3)
+            PackGroup(blocks + i, data);
+
+        // the last group is padded with empty blocks which leaves the padding bits zero
+        if (i < numBlocks)
+        {
+            Block group[8] = {};
+            std::copy(blocks + i, blocks + numBlocks, group);
+            std::byte b[3];
+            PackGroup(group, b);
+            std::copy(b, b + GetDataLength(numBlocks - i), data);
+        }
+    }
+
+    void UnpackBlocksScalar(const std::byte* data, std::size_t numBlocks, Block* blocks)
+    {
+        std::size_t i = 0;
+        for (; i + 8 <= numBlocks; i += 8, data += 3)
+            UnpackGroup(data, blocks + i);
+
+        if (i < numBlocks)
+        {
+            std::byte b[3] = {};
+            std::copy(data, data + GetDataLength(numBlocks - i), b);
+            Block group[8];
+            UnpackGroup(b, group);
+            std::copy(group, group + (numBlocks - i), blocks + i);
+        }
+    }
+
+    unsigned int GetBlockColorsScalar(const Block* blocks, std::size_t numBlocks)
+    {
+        unsigned int colors = 0;
+        for (std::size_t i = 0; i < numBlocks; i++)
+            colors |= 1u << static_cast<unsigned int>(blocks[i]);
+        return colors;
+    }
+
+    template <unsigned int BitsPerBlock>
+    void PackBlockCodes(const Block* blocks, std::size_t numBlocks, const std::array<unsigned char, 8>& codes, std::byte* data)
+    {
+        // every 8 blocks take up BitsPerBlock bytes, block i of a group being stored at bit i * BitsPerBlock
+        auto packGroup = [&](const Block* group, std::size_t size) {
+            unsigned int bits = 0;
+            for (std::size_t j = 0; j < size; j++)
+                bits |= static_cast<unsigned int>(codes[static_cast<unsigned int>(group[j])]) << (j * BitsPerBlock);
+            return bits;
+        };
+
+        std::size_t i = 0;
+        for (; i + 8 <= numBlocks; i += 8, data += BitsPerBlock)
+        {
+            unsigned int bits = packGroup(blocks + i, 8);
+            for (unsigned int j = 0; j < BitsPerBlock; j++)
+                data[j] = static_cast<std::byte>(bits >> (j * 8));
+        }
+
+        if (i < numBlocks)
+        {
+            unsigned int bits = packGroup(blocks + i, numBlocks - i);
+            for (std::size_t j = 0; j < ((numBlocks - i) * BitsPerBlock + 7) / 8; j++)
+                data[j] = static_cast<std::byte>(bits >> (j * 8));
+        }
+    }
+
+    template <unsigned int BitsPerBlock>
+    void UnpackBlockCodes(const std::byte* data, std::size_t numBlocks, const std::array<Block, 4>& blocksByCode, Block* blocks)
+    {
+        constexpr unsigned int codeMask = (1u << BitsPerBlock) - 1;
+
+        std::size_t i = 0;
+        for (; i + 8 <= numBlocks; i += 8, data += BitsPerBlock)
+        {
+            unsigned int bits = 0;
+            for (unsigned int j = 0; j < BitsPerBlock; j++)
+                bits |= static_cast<unsigned int>(data[j]) << (j * 8);
+            for (unsigned int j = 0; j < 8; j++)
+                blocks[i + j] = blocksByCode[(bits >> (j * BitsPerBlock)) & codeMask];
+        }
+
+        if (i < numBlocks)
+        {
+            unsigned int bits = 0;
+            for (std::size_t j = 0; j < ((numBlocks - i) * BitsPerBlock + 7) / 8; j++)
+                bits |= static_cast<unsigned int>(data[j]) << (j * 8);
+            for (std::size_t j = 0; i + j < numBlocks; j++)
+                blocks[i + j] = blocksByCode[(bits >> (j * BitsPerBlock)) & codeMask];
+        }
+    }
+
+#if defined(SGBUST_X64)
+    struct CpuFeatures
+    {
+        bool Ssse3 = false;
+        bool Bmi2 = false;
+        bool Avx2 = false;
+        bool Avx512Bw = false;
+    };
+
+    void GetCpuId(unsigned int leaf, unsigned int subleaf, unsigned int (&registers)[4])
+    {
+#if defined(_MSC_VER)
+        int r[4];
+        __cpuidex(r, leaf, subleaf);
+        for (int i = 0; i < 4; i++)
+            registers[i] = r[i];
+#else
+        __cpuid_count(leaf, subleaf, registers[0], registers[1], registers[2], registers[3]);
+#endif
+    }
+
+    std::uint64_t GetEnabledXStateFeatures()
+    {
+#if defined(_MSC_VER)
+        return _xgetbv(0);
+#else
+        unsigned int eax, edx;
+        __asm__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+        return (static_cast<std::uint64_t>(edx) << 32) | eax;
+#endif
+    }
+
+    CpuFeatures DetectCpuFeatures()
+    {
+        CpuFeatures features;
+
+        unsigned int leaf0[4], leaf1[4], leaf7[4] = {};
+        GetCpuId(0, 0, leaf0);
+        GetCpuId(1, 0, leaf1);
+        if (leaf0[0] >= 7)
+            GetCpuId(7, 0, leaf7);
+
+        // AVX state must be enabled by the OS in addition to being supported by the CPU
+        bool osxsave = (leaf1[2] & (1u << 27)) != 0;
+        std::uint64_t xstate = osxsave ? GetEnabledXStateFeatures() : 0;
+        bool avxEnabled = (xstate & 0x06) == 0x06;
+        bool avx512Enabled = (xstate & 0xE6) == 0xE6;
+
+        features.Ssse3 = (leaf1[2] & (1u << 9)) != 0;
+        features.Bmi2 = (leaf7[1] & (1u << 8)) != 0;
+        features.Avx2 = avxEnabled && (leaf7[1] & (1u << 5)) != 0;
+        features.Avx512Bw = avx512Enabled && (leaf7[1] & (1u << 16)) != 0 && (leaf7[1] & (1u << 30)) != 0;
+
+        return features;
+    }
+
+    const CpuFeatures& GetCpuFeatures()
+    {
+        static const CpuFeatures features = DetectCpuFeatures();
+        return features;
+    }
+
+    // maps each block to its bits rotated right/left by one within 3 bits
+    constexpr char RotateRightTable[16] = { 0, 4, 1, 5, 2, 6, 3, 7 };
+    constexpr char RotateLeftTable[16] = { 0, 2, 4, 6, 1, 3, 5, 7 };
+
+    // byte masks selecting blocks 2 and 5 of each group
+    constexpr char Block2Mask[16] = { 0, 0, -1, 0, 0, 0, 0, 0, 0, 0, -1, 0, 0, 0, 0, 0 };
+    constexpr char Block5Mask[16] = { 0, 0, 0, 0, 0, -1, 0, 0, 0, 0, 0, 0, 0, -1, 0, 0 };
+
+    // for unpacking, selects the two bytes containing the bits of each block of the first and second group
+    constexpr char SpreadGroup0[16] = { 0, 1, 0, 1, 0, 1, 1, 2, 1, 2, 1, 2, 2, 3, 2, 3 };
+    constexpr char SpreadGroup1[16] = { 3, 4, 3, 4, 3, 4, 4, 5, 4, 5, 4, 5, 5, 6, 5, 6 };
+
+    // for packing, collects the three bytes of both groups after they have been combined in 64-bit lanes
+    constexpr char GatherGroups[16] = { 0, 1, 2, 8, 9, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 };
+
+    // multiplying by these moves the bits of each block to bits 8..10 of its 16-bit lane
+    constexpr short UnpackShifts[8] = { 256, 32, 4, 128, 16, 2, 64, 8 };
+
+    SGBUST_TARGET("bmi2")
+    void PackBlocksBmi2(const Block* blocks, std::size_t numBlocks, std::byte* data)
+    {
+        constexpr std::uint64_t blockBits = 0x0707070707070707;
+        constexpr std::uint64_t block2 = 0xFFull << 16;
+        constexpr std::uint64_t block5 = 0xFFull << 40;
+
+        std::size_t i = 0;
+        for (; i + 8 <= numBlocks; i += 8, data += 3)
+        {
+            std::uint64_t v;
+            std::memcpy(&v, blocks + i, 8);
+            v = (v & ~(block2 | block5)) |
+                ((v >> 1) & (0x03ull << 16)) | ((v << 2) & (0x04ull << 16)) |
+                ((v >> 2) & (0x01ull << 40)) | ((v << 1) & (0x06ull << 40));
+            std::uint32_t bits = static_cast<std::uint32_t>(_pext_u64(v, blockBits));
+            data[0] = static_cast<std::byte>(bits);
+            data[1] = static_cast<std::byte>(bits >> 8);
+            data[2] = static_cast<std::byte>(bits >> 16);
+        }
+
+        PackBlocksScalar(blocks + i, numBlocks - i, data);
+    }
+
+    SGBUST_TARGET("bmi2")
+    void UnpackBlocksBmi2(const std::byte* data, std::size_t numBlocks, Block* blocks)
+    {
+        constexpr std::uint64_t blockBits = 0x0707070707070707;
+
+        std::size_t i = 0;
+        for (; i + 8 <= numBlocks; i += 8, data += 3)
+        {
+            std::uint32_t bits = static_cast<std::uint32_t>(data[0]) | (static_cast<std::uint32_t>(data[1]) << 8) | (static_cast<std::uint32_t>(data[2]) << 16);
+            std::uint64_t v = _pdep_u64(bits, blockBits);
+            v = (v & ~((0xFFull << 16) | (0xFFull << 40))) |
+                ((v << 1) & (0x06ull << 16)) | ((v >> 2) & (0x01ull << 16)) |
+                ((v >> 1) & (0x03ull << 40)) | ((v << 2) & (0x04ull << 40));
+            std::memcpy(blocks + i, &v, 8);
+        }
+
+        UnpackBlocksScalar(data, numBlocks - i, blocks + i);
+    }
+
+    SGBUST_TARGET("ssse3")
+    void PackBlocksSsse3(const Block* blocks, std::size_t numBlocks, std::byte* data)
+    {
+        const __m128i rotateRight = _mm_loadu_si128(reinterpret_cast<const __m128i*>(RotateRightTable));
+        const __m128i rotateLeft = _mm_loadu_si128(reinterpret_cast<const __m128i*>(RotateLeftTable));
+        const __m128i block2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(Block2Mask));
+        const __m128i block5 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(Block5Mask));
+        const __m128i gather = _mm_loadu_si128(reinterpret_cast<const __m128i*>(GatherGroups));
+
+        std::byte* dataEnd = data + GetDataLength(numBlocks);
+
+        std::size_t i = 0;
+        for (; i + 16 <= numBlocks; i += 16, data += 6)
+        {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(blocks + i));
+            v = _mm_or_si128(_mm_andnot_si128(_mm_or_si128(block2, block5), v),
+                _mm_or_si128(_mm_and_si128(block2, _mm_shuffle_epi8(rotateRight, v)), _mm_and_si128(block5, _mm_shuffle_epi8(rotateLeft, v))));
+
+            __m128i pairs = _mm_maddubs_epi16(v, _mm_set1_epi16(0x0801));
+            __m128i quads = _mm_madd_epi16(pairs, _mm_set1_epi32(0x00400001));
+            __m128i groups = _mm_or_si128(quads, _mm_srli_epi64(quads, 20));
+            __m128i packed = _mm_shuffle_epi8(groups, gather);
+
+            if (dataEnd - data >= 8)
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(data), packed);
+            else
+            {
+                std::byte b[16];
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(b), packed);
+                std::memcpy(data, b, 6);
+            }
+        }
+
+        PackBlocksScalar(blocks + i, numBlocks - i, data);
+    }
+
+    SGBUST_TARGET("ssse3")
+    void UnpackBlocksSsse3(const std::byte* data, std::size_t numBlocks, Block* blocks)
+    {
+        const __m128i rotateRight = _mm_loadu_si128(reinterpret_cast<const __m128i*>(RotateRightTable));
+        const __m128i rotateLeft = _mm_loadu_si128(reinterpret_cast<const __m128i*>(RotateLeftTable));
+        const __m128i block2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(Block2Mask));
+        const __m128i block5 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(Block5Mask));
+        const __m128i spread0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(SpreadGroup0));
+        const __m128i spread1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(SpreadGroup1));
+        const __m128i shifts = _mm_loadu_si128(reinterpret_cast<const __m128i*>(UnpackShifts));
+
+        const std::byte* dataEnd = data + GetDataLength(numBlocks);
+
+        std::size_t i = 0;
+        for (; i + 16 <= numBlocks; i += 16, data += 6)
+        {
+            __m128i in;
+            if (dataEnd - data >= 8)
+                in = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(data));
+            else
+            {
+                std::byte b[16] = {};
+                std::memcpy(b, data, 6);
+                in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b));
+            }
+
+            __m128i group0 = _mm_srli_epi16(_mm_mullo_epi16(_mm_shuffle_epi8(in, spread0), shifts), 8);
+            __m128i group1 = _mm_srli_epi16(_mm_mullo_epi16(_mm_shuffle_epi8(in, spread1), shifts), 8);
+            __m128i v = _mm_and_si128(_mm_packus_epi16(group0, group1), _mm_set1_epi8(0b111));
+            v = _mm_or_si128(_mm_andnot_si128(_mm_or_si128(block2, block5), v),
+                _mm_or_si128(_mm_and_si128(block2, _mm_shuffle_epi8(rotateLeft, v)), _mm_and_si128(block5, _mm_shuffle_epi8(rotateRight, v))));
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(blocks + i), v);
+        }
+
+        UnpackBlocksScalar(data, numBlocks - i, blocks + i);
+    }
+
+    SGBUST_TARGET("avx2")
+    void PackBlocksAvx2(const Block* blocks, std::size_t numBlocks, std::byte* data)
+    {
+        const __m256i rotateRight = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(RotateRightTable)));
+        const __m256i rotateLeft = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(RotateLeftTable)));
+        const __m256i block2 = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(Block2Mask)));
+        const __m256i block5 = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(Block5Mask)));
+        const __m256i gather = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(GatherGroups)));
+
+        std::byte* dataEnd = data + GetDataLength(numBlocks);
+
+        std::size_t i = 0;
+        for (; i + 32 <= numBlocks; i += 32, data += 12)
+        {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(blocks + i));
+            v = _mm256_or_si256(_mm256_andnot_si256(_mm256_or_si256(block2, block5), v),
+                _mm256_or_si256(_mm256_and_si256(block2, _mm256_shuffle_epi8(rotateRight, v)), _mm256_and_si256(block5, _mm256_shuffle_epi8(rotateLeft, v))));
+
+            __m256i pairs = _mm256_maddubs_epi16(v, _mm256_set1_epi16(0x0801));
+            __m256i quads = _mm256_madd_epi16(pairs, _mm256_set1_epi32(0x00400001));
+            __m256i groups = _mm256_or_si256(quads, _mm256_srli_epi64(quads, 20));
+            __m256i packed = _mm256_shuffle_epi8(groups, gather);
+
+            // each 128-bit lane holds 6 bytes, the second store overwrites the two excess bytes of the first one
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(data), _mm256_castsi256_si128(packed));
+            if (dataEnd - data >= 14)
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(data + 6), _mm256_extracti128_si256(packed, 1));
+            else
+            {
+                std::byte b[16];
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(b), _mm256_extracti128_si256(packed, 1));
+                std::memcpy(data + 6, b, 6);
+            }
+        }
+
+        PackBlocksSsse3(blocks + i, numBlocks - i, data);
+    }
+
+    SGBUST_TARGET("avx2")
+    void UnpackBlocksAvx2(const std::byte* data, std::size_t numBlocks, Block* blocks)
+    {
+        const __m256i rotateRight = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(RotateRightTable)));
+        const __m256i rotateLeft = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(RotateLeftTable)));
+        const __m256i block2 = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(Block2Mask)));
+        const __m256i block5 = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(Block5Mask)));
+        const __m256i spread0 = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(SpreadGroup0)));
+        const __m256i spread1 = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(SpreadGroup1)));
+        const __m256i shifts = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(UnpackShifts)));
+
+        const std::byte* dataEnd = data + GetDataLength(numBlocks);
+
+        std::size_t i = 0;
+        for (; i + 32 <= numBlocks; i += 32, data += 12)
+        {
+            // each 128-bit lane gets 6 bytes holding 16 blocks
+            __m256i in;
+            if (dataEnd - data >= 14)
+                in = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(data))),
+                    _mm_loadl_epi64(reinterpret_cast<const __m128i*>(data + 6)), 1);
+            else
+            {
+                std::byte b[16] = {};
+                std::memcpy(b, data, 12);
+                in = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(b))),
+                    _mm_loadl_epi64(reinterpret_cast<const __m128i*>(b + 6)), 1);
+            }
+
+            __m256i group0 = _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_shuffle_epi8(in, spread0), shifts), 8);
+            __m256i group1 = _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_shuffle_epi8(in, spread1), shifts), 8);
+            __m256i v = _mm256_and_si256(_mm256_packus_epi16(group0, group1), _mm256_set1_epi8(0b111));
+            v = _mm256_or_si256(_mm256_andnot_si256(_mm256_or_si256(block2, block5), v),
+                _mm256_or_si256(_mm256_and_si256(block2, _mm256_shuffle_epi8(rotateLeft, v)), _mm256_and_si256(block5, _mm256_shuffle_epi8(rotateRight, v))));
+
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(blocks + i), v);
+        }
+
+        UnpackBlocksSsse3(data, numBlocks - i, blocks + i);
+    }
+
+    SGBUST_TARGET("avx512f,avx512bw")
+    void PackBlocksAvx512(const Block* blocks, std::size_t numBlocks, std::byte* data)
+    {
+        const __m512i rotateRight = _mm512_broadcast_i32x4(_mm_loadu_si128(reinterpret_cast<const __m128i*>(RotateRightTable)));
+        const __m512i rotateLeft = _mm512_broadcast_i32x4(_mm_loadu_si128(reinterpret_cast<const __m128i*>(RotateLeftTable)));
+        const __m512i gather = _mm512_broadcast_i32x4(_mm_loadu_si128(reinterpret_cast<const __m128i*>(GatherGroups)));
+        // moves the 3 words holding the 6 bytes of each 128-bit lane next to each other
+        const __m512i compress = _mm512_set_epi16(
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, 0, 26, 25, 24, 18, 17, 16, 10, 9, 8, 2, 1, 0);
+
+        std::size_t i = 0;
+        for (; i + 64 <= numBlocks; i += 64, data += 24)
+        {
+            __m512i v = _mm512_loadu_si512(blocks + i);
+            v = _mm512_mask_shuffle_epi8(v, 0x0404040404040404, rotateRight, v);
+            v = _mm512_mask_shuffle_epi8(v, 0x2020202020202020, rotateLeft, v);
+
+            __m512i pairs = _mm512_maddubs_epi16(v, _mm512_set1_epi16(0x0801));
+            __m512i quads = _mm512_madd_epi16(pairs, _mm512_set1_epi32(0x00400001));
+            __m512i groups = _mm512_or_si512(quads, _mm512_srli_epi64(quads, 20));
+            __m512i packed = _mm512_permutexvar_epi16(compress, _mm512_shuffle_epi8(groups, gather));
+
+            _mm512_mask_storeu_epi8(data, 0xFFFFFF, packed);
+        }
+
+        PackBlocksAvx2(blocks + i, numBlocks - i, data);
+    }
+
+    SGBUST_TARGET("avx512f,avx512bw")
+    void UnpackBlocksAvx512(const std::byte* data, std::size_t numBlocks, Block* blocks)
+    {
+        const __m512i rotateRight = _mm512_broadcast_i32x4(_mm_loadu_si128(reinterpret_cast<const __m128i*>(RotateRightTable)));
+        const __m512i rotateLeft = _mm512_broadcast_i32x4(_mm_loadu_si128(reinterpret_cast<const __m128i*>(RotateLeftTable)));
+        const __m512i spread0 = _mm512_broadcast_i32x4(_mm_loadu_si128(reinterpret_cast<const __m128i*>(SpreadGroup0)));
+        const __m512i spread1 = _mm512_broadcast_i32x4(_mm_loadu_si128(reinterpret_cast<const __m128i*>(SpreadGroup1)));
+        const __m512i shifts = _mm512_broadcast_i32x4(_mm_loadu_si128(reinterpret_cast<const __m128i*>(UnpackShifts)));
+        // gives each 128-bit lane the 3 words (16 blocks) it unpacks, plus one more word
+        const __m512i expand = _mm512_set_epi16(
+            0, 0, 0, 0, 12, 11, 10, 9, 0, 0, 0, 0, 9, 8, 7, 6,
+            0, 0, 0, 0, 6, 5, 4, 3, 0, 0, 0, 0, 3, 2, 1, 0);
+
+        std::size_t i = 0;
+        for (; i + 64 <= numBlocks; i += 64, data += 24)
+        {
+            __m512i in = _mm512_permutexvar_epi16(expand, _mm512_maskz_loadu_epi8(0xFFFFFF, data));
+
+            __m512i group0 = _mm512_srli_epi16(_mm512_mullo_epi16(_mm512_shuffle_epi8(in, spread0), shifts), 8);
+            __m512i group1 = _mm512_srli_epi16(_mm512_mullo_epi16(_mm512_shuffle_epi8(in, spread1), shifts), 8);
+            __m512i v = _mm512_and_si512(_mm512_packus_epi16(group0, group1), _mm512_set1_epi8(0b111));
+            v = _mm512_mask_shuffle_epi8(v, 0x0404040404040404, rotateLeft, v);
+            v = _mm512_mask_shuffle_epi8(v, 0x2020202020202020, rotateRight, v);
+
+            _mm512_storeu_si512(blocks + i, v);
+        }
+
+        UnpackBlocksAvx2(data, numBlocks - i, blocks + i);
+    }
+
+    // maps each block to a byte with only the bit of its value set
+    constexpr char ColorBitTable[16] = { 1, 2, 4, 8, 16, 32, 64, -128 };
+
+    SGBUST_TARGET("ssse3")
+    unsigned int GetBlockColorsSsse3(const Block* blocks, std::size_t numBlocks)
+    {
+        if (numBlocks < 16)
+            return GetBlockColorsScalar(blocks, numBlocks);
+
+        const __m128i colorBits = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ColorBitTable));
+
+        __m128i colors = _mm_setzero_si128();
+
+        // the last vector may overlap with the previous one, which does not change the result
+        for (std::size_t i = 0; i < numBlocks; i += 16)
+        {
+            std::size_t offset = std::min(i, numBlocks - 16);
+            colors = _mm_or_si128(colors, _mm_shuffle_epi8(colorBits, _mm_loadu_si128(reinterpret_cast<const __m128i*>(blocks + offset))));
+        }
+
+        colors = _mm_or_si128(colors, _mm_srli_si128(colors, 8));
+        colors = _mm_or_si128(colors, _mm_srli_si128(colors, 4));
+        colors = _mm_or_si128(colors, _mm_srli_si128(colors, 2));
+        colors = _mm_or_si128(colors, _mm_srli_si128(colors, 1));
+
+        return _mm_cvtsi128_si32(colors) & 0xFF;
+    }
+
+    SGBUST_TARGET("avx2")
+    unsigned int GetBlockColorsAvx2(const Block* blocks, std::size_t numBlocks)
+    {
+        if (numBlocks < 32)
+            return GetBlockColorsSsse3(blocks, numBlocks);
+
+        const __m256i colorBits = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ColorBitTable)));
+
+        __m256i colors = _mm256_setzero_si256();
+
+        for (std::size_t i = 0; i < numBlocks; i += 32)
+        {
+            std::size_t offset = std::min(i, numBlocks - 32);
+            colors = _mm256_or_si256(colors, _mm256_shuffle_epi8(colorBits, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(blocks + offset))));
+        }
+
+        __m128i colors128 = _mm_or_si128(_mm256_castsi256_si128(colors), _mm256_extracti128_si256(colors, 1));
+        colors128 = _mm_or_si128(colors128, _mm_srli_si128(colors128, 8));
+        colors128 = _mm_or_si128(colors128, _mm_srli_si128(colors128, 4));
+        colors128 = _mm_or_si128(colors128, _mm_srli_si128(colors128, 2));
+        colors128 = _mm_or_si128(colors128, _mm_srli_si128(colors128, 1));
+
+        return _mm_cvtsi128_si32(colors128) & 0xFF;
+    }
+
+    template <unsigned int BitsPerBlock>
+    SGBUST_TARGET("ssse3")
+    void PackBlockCodesSsse3(const Block* blocks, std::size_t numBlocks, const std::array<unsigned char, 8>& codes, std::byte* data)
+    {
+        unsigned char codeTable[16] = {};
+        std::copy(codes.begin(), codes.end(), codeTable);
+        const __m128i blockCodes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(codeTable));
+        const __m128i gather = _mm_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+
+        std::size_t i = 0;
+        for (; i + 16 <= numBlocks; i += 16, data += 2 * BitsPerBlock)
+        {
+            __m128i c = _mm_shuffle_epi8(blockCodes, _mm_loadu_si128(reinterpret_cast<const __m128i*>(blocks + i)));
+
+            if constexpr (BitsPerBlock == 1)
+            {
+                std::uint16_t bits = static_cast<std::uint16_t>(_mm_movemask_epi8(_mm_slli_epi64(c, 7)));
+                std::memcpy(data, &bits, 2);
+            }
+            else
+            {
+                __m128i pairs = _mm_maddubs_epi16(c, _mm_set1_epi16(0x0401));
+                __m128i quads = _mm_madd_epi16(pairs, _mm_set1_epi32(0x00100001));
+                std::uint32_t bits = static_cast<std::uint32_t>(_mm_cvtsi128_si32(_mm_shuffle_epi8(quads, gather)));
+                std::memcpy(data, &bits, 4);
+            }
+        }
+
+        PackBlockCodes<BitsPerBlock>(blocks + i, numBlocks - i, codes, data);
+    }
+
+    template <unsigned int BitsPerBlock>
+    SGBUST_TARGET("ssse3")
+    void UnpackBlockCodesSsse3(const std::byte* data, std::size_t numBlocks, const std::array<Block, 4>& blocksByCode, Block* blocks)
+    {
+        Block blockTable[16] = {};
+        std::copy(blocksByCode.begin(), blocksByCode.end(), blockTable);
+        const __m128i codeBlocks = _mm_loadu_si128(reinterpret_cast<const __m128i*>(blockTable));
+
+        std::size_t i = 0;
+        for (; i + 16 <= numBlocks; i += 16, data += 2 * BitsPerBlock)
+        {
+            // each byte gets the byte holding its code, then the bits of the code are tested one by one
+            __m128i c;
+
+            if constexpr (BitsPerBlock == 1)
+            {
+                std::uint16_t bits;
+                std::memcpy(&bits, data, 2);
+                __m128i spread = _mm_shuffle_epi8(_mm_cvtsi32_si128(bits), _mm_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1));
+                __m128i bit0 = _mm_set1_epi64x(0x8040201008040201);
+                c = _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(spread, bit0), bit0), _mm_set1_epi8(1));
+            }
+            else
+            {
+                std::uint32_t bits;
+                std::memcpy(&bits, data, 4);
+                __m128i spread = _mm_shuffle_epi8(_mm_cvtsi32_si128(bits), _mm_setr_epi8(0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3));
+                __m128i bit0 = _mm_set1_epi32(0x40100401);
+                __m128i bit1 = _mm_set1_epi32(static_cast<int>(0x80200802));
+                c = _mm_or_si128(_mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(spread, bit0), bit0), _mm_set1_epi8(1)),
+                    _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(spread, bit1), bit1), _mm_set1_epi8(2)));
+            }
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(blocks + i), _mm_shuffle_epi8(codeBlocks, c));
+        }
+
+        UnpackBlockCodes<BitsPerBlock>(data, numBlocks - i, blocksByCode, blocks + i);
+    }
+
+    template <unsigned int BitsPerBlock>
+    SGBUST_TARGET("avx2")
+    void PackBlockCodesAvx2(const Block* blocks, std::size_t numBlocks, const std::array<unsigned char, 8>& codes, std::byte* data)
+    {
+        unsigned char codeTable[16] = {};
+        std::copy(codes.begin(), codes.end(), codeTable);
+        const __m256i blockCodes = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(codeTable)));
+        const __m256i gather = _mm256_broadcastsi128_si256(_mm_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1));
+
+        std::size_t i = 0;
+        for (; i + 32 <= numBlocks; i += 32, data += 4 * BitsPerBlock)
+        {
+            __m256i c = _mm256_shuffle_epi8(blockCodes, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(blocks + i)));
+
+            if constexpr (BitsPerBlock == 1)
+            {
+                std::uint32_t bits = static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_slli_epi64(c, 7)));
+                std::memcpy(data, &bits, 4);
+            }
+            else
+            {
+                __m256i pairs = _mm256_maddubs_epi16(c, _mm256_set1_epi16(0x0401));
+                __m256i quads = _mm256_madd_epi16(pairs, _mm256_set1_epi32(0x00100001));
+                __m256i packed = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(quads, gather), _mm256_setr_epi32(0, 4, 0, 0, 0, 0, 0, 0));
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(data), _mm256_castsi256_si128(packed));
+            }
+        }
+
+        PackBlockCodesSsse3<BitsPerBlock>(blocks + i, numBlocks - i, codes, data);
+    }
+
+    template <unsigned int BitsPerBlock>
+    SGBUST_TARGET("avx2")
+    void UnpackBlockCodesAvx2(const std::byte* data, std::size_t numBlocks, const std::array<Block, 4>& blocksByCode, Block* blocks)
+    {
+        Block blockTable[16] = {};
+        std::copy(blocksByCode.begin(), blocksByCode.end(), blockTable);
+        const __m256i codeBlocks = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(blockTable)));
+
+        std::size_t i = 0;
+        for (; i + 32 <= numBlocks; i += 32, data += 4 * BitsPerBlock)
+        {
+            __m256i c;
+
+            if constexpr (BitsPerBlock == 1)
+            {
+                std::uint32_t bits;
+                std::memcpy(&bits, data, 4);
+                __m256i spread = _mm256_shuffle_epi8(_mm256_set1_epi32(static_cast<int>(bits)), _mm256_setr_epi8(
+                    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3));
+                __m256i bit0 = _mm256_set1_epi64x(0x8040201008040201);
+                c = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_and_si256(spread, bit0), bit0), _mm256_set1_epi8(1));
+            }
+            else
+            {
+                std::uint64_t bits;
+                std::memcpy(&bits, data, 8);
+                __m256i spread = _mm256_shuffle_epi8(_mm256_set1_epi64x(static_cast<long long>(bits)), _mm256_setr_epi8(
+                    0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 6, 6, 6, 6, 7, 7, 7, 7));
+                __m256i bit0 = _mm256_set1_epi32(0x40100401);
+                __m256i bit1 = _mm256_set1_epi32(static_cast<int>(0x80200802));
+                c = _mm256_or_si256(_mm256_and_si256(_mm256_cmpeq_epi8(_mm256_and_si256(spread, bit0), bit0), _mm256_set1_epi8(1)),
+                    _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_and_si256(spread, bit1), bit1), _mm256_set1_epi8(2)));
+            }
+
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(blocks + i), _mm256_shuffle_epi8(codeBlocks, c));
+        }
+
+        UnpackBlockCodesSsse3<BitsPerBlock>(data, numBlocks - i, blocksByCode, blocks + i);
+    }
+#endif
+
+    using PackFunc = void (*)(const Block* blocks, std::size_t numBlocks, std::byte* data);
+    using UnpackFunc = void (*)(const std::byte* data, std::size_t numBlocks, Block* blocks);
+    using ColorsFunc = unsigned int (*)(const Block* blocks, std::size_t numBlocks);
+    using PackCodesFunc = void (*)(const Block* blocks, std::size_t numBlocks, const std::array<unsigned char, 8>& codes, std::byte* data);
+    using UnpackCodesFunc = void (*)(const std::byte* data, std::size_t numBlocks, const std::array<Block, 4>& blocksByCode, Block* blocks);
+
+    struct Kernel
+    {
+        PackingKernel Type;
+        PackFunc Pack;
+        UnpackFunc Unpack;
+        ColorsFunc Colors;
+        // indexed by the number of bits per block minus one
+        std::array<PackCodesFunc, 2> PackCodes;
+        std::array<UnpackCodesFunc, 2> UnpackCodes;
+    };
+
+    Kernel GetKernel(PackingKernel kernel)
+    {
+        switch (kernel)
+        {
+#if defined(SGBUST_X64)
+        case PackingKernel::Bmi2:
+            return { kernel, PackBlocksBmi2, UnpackBlocksBmi2, GetBlockColorsScalar,
+                { PackBlockCodes<1>, PackBlockCodes<2> }, { UnpackBlockCodes<1>, UnpackBlockCodes<2> } };
+        case PackingKernel::Ssse3:
+            return { kernel, PackBlocksSsse3, UnpackBlocksSsse3, GetBlockColorsSsse3,
+                { PackBlockCodesSsse3<1>, PackBlockCodesSsse3<2> }, { UnpackBlockCodesSsse3<1>, UnpackBlockCodesSsse3<2> } };
+        case PackingKernel::Avx2:
+            return { kernel, PackBlocksAvx2, UnpackBlocksAvx2, GetBlockColorsAvx2,
+                { PackBlockCodesAvx2<1>, PackBlockCodesAvx2<2> }, { UnpackBlockCodesAvx2<1>, UnpackBlockCodesAvx2<2> } };
+        case PackingKernel::Avx512:
+            return { kernel, PackBlocksAvx512, UnpackBlocksAvx512, GetBlockColorsAvx2,
+                { PackBlockCodesAvx2<1>, PackBlockCodesAvx2<2> }, { UnpackBlockCodesAvx2<1>, UnpackBlockCodesAvx2<2> } };
+#endif
+        default:
+            return { PackingKernel::Scalar, PackBlocksScalar, UnpackBlocksScalar, GetBlockColorsScalar,
+                { PackBlockCodes<1>, PackBlockCodes<2> }, { UnpackBlockCodes<1>, UnpackBlockCodes<2> } };
+        }
+    }
+
+    Kernel SelectKernel()
+    {
+        // ordered from fastest to slowest
+        for (PackingKernel kernel : { PackingKernel::Avx512, PackingKernel::Avx2, PackingKernel::Ssse3, PackingKernel::Bmi2 })
+            if (sgbust::IsPackingKernelSupported(kernel))
+                return GetKernel(kernel);
+
+        return GetKernel(PackingKernel::Scalar);
+    }
+
+    Kernel& GetCurrentKernel()
+    {
+        static Kernel kernel = SelectKernel();
+        return kernel;
+    }
+}
+
+namespace sgbust
+{
+    void PackBlocks(const Block* blocks, std::size_t numBlocks, std::byte* data)
+    {
+        GetCurrentKernel().Pack(blocks, numBlocks, data);
+    }
+
+    void UnpackBlocks(const std::byte* data, std::size_t numBlocks, Block* blocks)
+    {
+        GetCurrentKernel().Unpack(data, numBlocks, blocks);
+    }
+
+    unsigned int GetBlockColors(const Block* blocks, std::size_t numBlocks)
+    {
+        return GetCurrentKernel().Colors(blocks, numBlocks);
+    }
+
+    void PackBlockCodes(const Block* blocks, std::size_t numBlocks, unsigned int bitsPerBlock, const std::array<unsigned char, 8>& codes, std::byte* data)
+    {
+        if (bitsPerBlock != 1 && bitsPerBlock != 2)
+            throw std::invalid_argument("bitsPerBlock must be 1 or 2");
+
+        GetCurrentKernel().PackCodes[bitsPerBlock - 1](blocks, numBlocks, codes, data);
+    }
+
+    void UnpackBlockCodes(const std::byte* data, std::size_t numBlocks, unsigned int bitsPerBlock, const std::array<Block, 4>& blocksByCode, Block* blocks)
+    {
+        if (bitsPerBlock != 1 && bitsPerBlock != 2)
+            throw std::invalid_argument("bitsPerBlock must be 1 or 2");
+
+        GetCurrentKernel().UnpackCodes[bitsPerBlock - 1](data, numBlocks, blocksByCode, blocks);
+    }
+
+    bool IsPackingKernelSupported(PackingKernel kernel)
+    {
+        switch (kernel)
+        {
+        case PackingKernel::Scalar:
+            return true;
+#if defined(SGBUST_X64)
+        case PackingKernel::Bmi2:
+            return GetCpuFeatures().Bmi2;
+        case PackingKernel::Ssse3:
+            return GetCpuFeatures().Ssse3;
+        case PackingKernel::Avx2:
+            return GetCpuFeatures().Ssse3 && GetCpuFeatures().Avx2;
+        case PackingKernel::Avx512:
+            return GetCpuFeatures().Ssse3 && GetCpuFeatures().Avx2 && GetCpuFeatures().Avx512Bw;
+#endif
+        default:
+            return false;
+        }
+    }
+
+    PackingKernel GetPackingKernel()
+    {
+        return GetCurrentKernel().Type;
+    }
+
+    void SetPackingKernel(PackingKernel kernel)
+    {
+        if (!IsPackingKernelSupported(kernel))
+            throw std::invalid_argument("Packing kernel is not supported on this CPU");
+
+        GetCurrentKernel() = GetKernel(kernel);
+    }
+
+    const char* GetPackingKernelName(PackingKernel kernel)
+    {
+        switch (kernel)
+        {
+        case PackingKernel::Scalar:
+            return "scalar";
+        case PackingKernel::Bmi2:
+            return "bmi2";
+        case PackingKernel::Ssse3:
+            return "ssse3";
+        case PackingKernel::Avx2:
+            return "avx2";
+        case PackingKernel::Avx512:
+            return "avx512";
+        default:
+            return "unknown";
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,121 @@
+#include "core/BumpArena.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+
+namespace
+{
+    std::atomic<std::uint64_t> nextGeneration = 1;
+
+    // Part of the chunk of the calling thread that has not been handed out yet. Arenas get a new generation
+    // whenever they are reset, so a cursor is only valid if its generation matches the one of the arena.
+    struct Cursor
+    {
+        std::uint64_t Generation = 0;
+        std::byte* Next = nullptr;
+        std::byte* End = nullptr;
+        std::uint64_t LastUse = 0;
+    };
+
+    // every thread keeps cursors for the few arenas it allocated from most recently,
+    // so that alternating between arenas does not abandon the rest of their chunks
+    constexpr std::size_t NumCursors = 4;
+
+    thread_local std::array<Cursor, NumCursors> cursors;
+    thread_local std::uint64_t numCursorUses = 0;
+
+    Cursor* FindCursor(std::uint64_t generation)
+    {
+        for (Cursor& cursor : cursors)
+            if (cursor.Generation == generation)
+            {
+                cursor.LastUse = ++numCursorUses;
+                return &cursor;
+            }
+
+        return nullptr;
+    }
+
+    // cursors of arenas that have been reset since are never used again, so they are the least recently used ones
+    Cursor* LeastRecentlyUsedCursor()
+    {
+        return &*std::min_element(cursors.begin(), cursors.end(), [](const Cursor& a, const Cursor& b) { return a.LastUse < b.LastUse; });
+    }
+}
+
+namespace sgbust
+{
+    BumpArena::BumpArena() : generation(nextGeneration++)
+    {
+    }
+
+    BumpArena::Chunk BumpArena::TakeChunk(std::size_t minSize)
+    {
+        if (minSize <= ChunkSize && !freeChunks.empty())
+        {
+            Chunk chunk = std::move(freeChunks.back());
+            freeChunks.pop_back();
+            return chunk;
+        }
+
+        std::size_t size = std::max(minSize, ChunkSize);
+        return Chunk{ std::make_unique_for_overwrite<std::byte[]>(size), size };
+    }
+
+    std::byte* BumpArena::Allocate(std::size_t size)
+    {
+        Cursor* cursor = FindCursor(generation);
+
+        if (cursor == nullptr || static_cast<std::size_t>(cursor->End - cursor->Next) < size)
+        {
+            std::scoped_lock lock(mutex);
+
+            if (cursor == nullptr)
+                cursor = LeastRecentlyUsedCursor();
+
+            // the rest of the previous chunk of this thread is abandoned
+            Chunk& chunk = chunks.emplace_back(TakeChunk(size));
+            *cursor = Cursor{ generation, chunk.Data.get(), chunk.Data.get() + chunk.Size, ++numCursorUses };
+        }
+
+        std::byte* data = cursor->Next;
+        cursor->Next += size;
+        return data;
+    }
+
+    void BumpArena::Deallocate(const std::byte* data, std::size_t size)
+    {
+        Cursor* cursor = FindCursor(generation);
+
+        if (cursor != nullptr && data + size == cursor->Next)
+            cursor->Next -= size;
+    }
+
+    void BumpArena::Reset()
+    {
+        generation = nextGeneration++;
+
+        for (Chunk& chunk : chunks)
+            if (chunk.Size == ChunkSize)
+                freeChunks.push_back(std::move(chunk));
+
+        chunks.clear();
+    }
+
+    void BumpArena::Clear()
+    {
+        Reset();
+        freeChunks.clear();
+    }
+
+    std::size_t BumpArena::GetMemoryUsage() const
+    {
+        std::size_t size = 0;
+        for (const Chunk& chunk : chunks)
+            size += chunk.Size;
+        for (const Chunk& chunk : freeChunks)
+            size += chunk.Size;
+        return size;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,208 @@
+#include "core/Checkpoint.h"
+
+#include <algorithm>
+#include <format>
+#include <limits>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+
+namespace
+{
+    constexpr char Magic[4] = { 'S', 'G', 'B', 'C' };
+    constexpr std::uint32_t Version = 2;
+    constexpr std::size_t BufferSize = 1 << 20;
+
+#pragma pack(push, 1)
+    // Precedes the block data of every grid of the beam. Checkpoints are written in the native byte order,
+    // as they are meant to be resumed on the machine that wrote them.
+    struct GridRecord
+    {
+        unsigned char Width;
+        unsigned char Height;
+        unsigned char Colors;
+        sgbust::MoveLink History;
+        int ScoreValue;
+        float ScoreObjective;
+        std::uint32_t Hash;
+        std::uint16_t DataLength;
+    };
+#pragma pack(pop)
+
+    template <typename T>
+    void WriteValue(std::ostream& stream, const T& value)
+    {
+        stream.write(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    template <typename T>
+    T ReadValue(std::istream& stream)
+    {
+        T value;
+        stream.read(reinterpret_cast<char*>(&value), sizeof(value));
+        return value;
+    }
+}
+
+namespace sgbust
+{
+    CheckpointWriter::CheckpointWriter(std::filesystem::path path, const CheckpointState& state)
+        : path(std::move(path)), buffer(BufferSize)
+    {
+        tempPath = this->path;
+        tempPath += ".tmp";
+
+        file.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+        file.open(tempPath, std::ios_base::binary);
+        if (!file)
+            throw std::runtime_error(std::format("Could not create file {}", tempPath.string()));
+
+        file.write(Magic, sizeof(Magic));
+        WriteValue(file, Version);
+
+        WriteValue(file, state.StartGrid.Width);
+        WriteValue(file, state.StartGrid.Height);
+        file.write(reinterpret_cast<const char*>(state.StartGrid.BlocksBegin()), state.StartGrid.Width * state.StartGrid.Height);
+        WriteValue<std::uint32_t>(file, state.MinGroupSize);
+        WriteValue(file, state.StartScore.Value);
+        WriteValue(file, state.StartScore.Objective);
+
+        WriteValue<std::uint32_t>(file, state.Depth);
+        WriteValue<std::uint32_t>(file, state.BeamSize);
+        WriteValue<std::uint32_t>(file, state.GridsDiscarded);
+        WriteValue<std::uint64_t>(file, state.MergedBeyondKept);
+        WriteValue<std::uint64_t>(file, state.PendingMemoryUsage);
+
+        WriteValue<unsigned char>(file, state.BestScore.has_value());
+        WriteValue(file, state.BestScore.value_or(0));
+        std::vector<unsigned char> bestSteps = state.BestSolution.AsVector();
+        WriteValue<std::uint32_t>(file, static_cast<std::uint32_t>(bestSteps.size()));
+        file.write(reinterpret_cast<const char*>(bestSteps.data()), bestSteps.size());
+        WriteValue(file, state.BestLink);
+        WriteValue<std::uint32_t>(file, state.BestDepth);
+
+        WriteValue<std::uint32_t>(file, static_cast<std::uint32_t>(state.History.size()));
+        for (const std::vector<MoveLink>& table : state.History)
+        {
+            WriteValue<std::uint64_t>(file, table.size());
+            file.write(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(MoveLink));
+        }
+
+        // the number of grids is filled in once all of them are written
+        numGridsPosition = file.tellp();
+        WriteValue(file, numGrids);
+
+        if (file.fail())
+            throw std::runtime_error(std::format("Could not write to file {}", tempPath.string()));
+    }
+
+    CheckpointWriter::~CheckpointWriter()
+    {
+        if (!committed)
+        {
+            file.close();
+            std::error_code error;
+            std::filesystem::remove(tempPath, error);
+        }
+    }
+
+    void CheckpointWriter::Write(const CompactGrid& grid)
+    {
+        GridRecord record{ grid.Width, grid.Height, grid.Colors, grid.History, grid.Score.Value, grid.Score.Objective, grid.Hash, static_cast<std::uint16_t>(grid.DataLength()) };
+        WriteValue(file, record);
+        file.write(reinterpret_cast<const char*>(grid.Data()), record.DataLength);
+        numGrids++;
+    }
+
+    void CheckpointWriter::Commit()
+    {
+        file.seekp(numGridsPosition);
+        WriteValue(file, numGrids);
+        file.close();
+        if (file.fail())
+            throw std::runtime_error(std::format("Could not write to file {}", tempPath.string()));
+
+        std::filesystem::rename(tempPath, path);
+        committed = true;
+    }
+
+    CheckpointReader::CheckpointReader(std::filesystem::path path) : path(std::move(path)), buffer(BufferSize)
+    {
+        file.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+        file.open(this->path, std::ios_base::binary);
+        if (!file)
+            throw std::runtime_error(std::format("Could not open file {}", this->path.string()));
+
+        // Lengths read from the file are checked against the rest of the file before anything is allocated for them,
+        // so that a truncated or corrupt file is reported as such rather than making for a huge allocation
+        std::uint64_t fileSize = std::filesystem::file_size(this->path);
+        auto checkLength = [&](std::uint64_t length, std::size_t elementSize, std::uint64_t maxLength = std::numeric_limits<std::uint64_t>::max()) {
+            std::streamoff position = file ? static_cast<std::streamoff>(file.tellg()) : -1;
+            if (position < 0 || length > maxLength || length > (fileSize - std::min<std::uint64_t>(position, fileSize)) / elementSize)
+                throw std::runtime_error(std::format("Could not read from file {}", this->path.string()));
+            return length;
+        };
+
+        char magic[sizeof(Magic)];
+        file.read(magic, sizeof(magic));
+        if (!file || !std::equal(magic, magic + sizeof(magic), Magic))
+            throw std::runtime_error(std::format("{} is not a checkpoint file", this->path.string()));
+        if (ReadValue<std::uint32_t>(file) != Version)
+            throw std::runtime_error(std::format("Checkpoint file {} was written by an incompatible version", this->path.string()));
+
+        unsigned char width = ReadValue<unsigned char>(file);
+        unsigned char height = ReadValue<unsigned char>(file);
+        state.StartGrid = Grid(width, height);
+        file.read(reinterpret_cast<char*>(state.StartGrid.BlocksBegin()), width * height);
+        state.MinGroupSize = ReadValue<std::uint32_t>(file);
+        int startScoreValue = ReadValue<int>(file);
+        float startScoreObjective = ReadValue<float>(file);
+        state.StartScore = Score(startScoreValue, startScoreObjective);
+
+        state.Depth = ReadValue<std::uint32_t>(file);
+        state.BeamSize = ReadValue<std::uint32_t>(file);
+        state.GridsDiscarded = ReadValue<std::uint32_t>(file);
+        state.MergedBeyondKept = ReadValue<std::uint64_t>(file);
+        state.PendingMemoryUsage = ReadValue<std::uint64_t>(file);
+
+        bool hasBestScore = ReadValue<unsigned char>(file) != 0;
+        int bestScore = ReadValue<int>(file);
+        if (hasBestScore)
+            state.BestScore = bestScore;
+        // every step removes at least one block
+        std::vector<unsigned char> bestSteps(checkLength(ReadValue<std::uint32_t>(file), sizeof(unsigned char), 255 * 255));
+        file.read(reinterpret_cast<char*>(bestSteps.data()), bestSteps.size());
+        state.BestSolution = Solution(bestSteps);
+        state.BestLink = ReadValue<MoveLink>(file);
+        state.BestDepth = ReadValue<std::uint32_t>(file);
+
+        // there is one table for every depth that was expanded
+        state.History.resize(checkLength(ReadValue<std::uint32_t>(file), sizeof(std::uint64_t), state.Depth));
+        for (std::vector<MoveLink>& table : state.History)
+        {
+            table.resize(checkLength(ReadValue<std::uint64_t>(file), sizeof(MoveLink)));
+            file.read(reinterpret_cast<char*>(table.data()), table.size() * sizeof(MoveLink));
+        }
+
+        numGrids = ReadValue<std::uint64_t>(file);
+
+        if (!file)
+            throw std::runtime_error(std::format("Could not read from file {}", this->path.string()));
+    }
+
+    bool CheckpointReader::Read(CompactGrid& grid)
+    {
+        if (numRead == numGrids)
+            return false;
+
+        GridRecord record = ReadValue<GridRecord>(file);
+        data.resize(record.DataLength);
+        file.read(reinterpret_cast<char*>(data.data()), record.DataLength);
+        if (!file)
+            throw std::runtime_error(std::format("Could not read from file {}", path.string()));
+
+        grid = CompactGrid(record.Width, record.Height, record.Colors, data.data(), record.Hash, Score(record.ScoreValue, record.ScoreObjective), record.History);
+        numRead++;
+        return true;
+    }
+}
\ No newline at end of file
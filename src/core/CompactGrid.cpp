@@ -1,165 +1,209 @@
 #include "core/CompactGrid.h"
 
+#include <array>
+#include <bit>
+#include <iterator>
+#include <tuple>
+
+#include "core/BlockPacking.h"
 #include "core/Grid.h"
+#include "core/GridHash.h"
 
 namespace sgbust
 {
-    CompactGrid::CompactGrid() : Width(0), Height(0)
+    CompactGrid::CompactGrid() : Width(0), Height(0), Colors(0), Score(0), Hash(0), dataInArena(false)
+    {
+    }
+
+    CompactGrid::CompactGrid(const CompactGrid& grid) : Width(grid.Width), Height(grid.Height), Colors(grid.Colors), History(grid.History), Score(grid.Score), Hash(grid.Hash)
+    {
+        std::copy(grid.Data(), grid.Data() + grid.DataLength(), Allocate(nullptr));
+    }
+
+    CompactGrid::CompactGrid(const CompactGrid& grid, BumpArena& arena) : Width(grid.Width), Height(grid.Height), Colors(grid.Colors), History(grid.History), Score(grid.Score), Hash(grid.Hash)
     {
+        std::copy(grid.Data(), grid.Data() + grid.DataLength(), Allocate(&arena));
     }
 
-    CompactGrid::CompactGrid(const CompactGrid& grid) : Width(grid.Width), Height(grid.Height), Solution(grid.Solution)
+    CompactGrid::CompactGrid(CompactGrid&& grid) noexcept : Width(grid.Width), Height(grid.Height), Colors(grid.Colors), History(grid.History), Score(grid.Score), Hash(grid.Hash), dataInArena(grid.dataInArena)
     {
-        Data = std::make_unique_for_overwrite<std::byte[]>(grid.DataLength());
-        std::copy(grid.Data.get(), grid.Data.get() + grid.DataLength(), Data.get());
+        std::copy(std::begin(grid.inlineData), std::end(grid.inlineData), inlineData);
+        grid.Width = 0;
+        grid.Height = 0;
     }
 
-    CompactGrid::CompactGrid(CompactGrid&& grid) noexcept : Width(grid.Width), Height(grid.Height), Data(std::move(grid.Data)), Solution(std::move(grid.Solution))
+    CompactGrid::CompactGrid(const Grid& grid, const sgbust::Score& score, const MoveLink& history) : Width(grid.Width), Height(grid.Height), History(history), Score(score), Hash(HashGrid(grid))
     {
+        Compact(grid, nullptr);
     }
 
-    CompactGrid::CompactGrid(const Grid& grid) : Width(grid.Width), Height(grid.Height), Solution(grid.Solution)
+    CompactGrid::CompactGrid(const Grid& grid, std::uint32_t hash, const sgbust::Score& score, const MoveLink& history, BumpArena& arena)
+        : Width(grid.Width), Height(grid.Height), History(history), Score(score), Hash(hash)
     {
-        Compact(grid);
+        Compact(grid, &arena);
     }
 
-    CompactGrid::CompactGrid(Grid&& grid) : Width(grid.Width), Height(grid.Height), Solution(std::move(grid.Solution))
+    CompactGrid::CompactGrid(unsigned char width, unsigned char height, unsigned char colors, const std::byte* data, std::uint32_t hash, const sgbust::Score& score, const MoveLink& history)
+        : Width(width), Height(height), Colors(colors), History(history), Score(score), Hash(hash)
     {
-        Compact(grid);
+        std::copy(data, data + DataLength(), Allocate(nullptr));
     }
 
     CompactGrid& CompactGrid::operator=(const CompactGrid& grid)
     {
-        Width = grid.Width;
-        Height = grid.Height;
-        Data = std::make_unique_for_overwrite<std::byte[]>(grid.DataLength());
-        std::copy(grid.Data.get(), grid.Data.get() + grid.DataLength(), Data.get());
-        Solution = grid.Solution;
+        if (this != &grid)
+        {
+            Free();
+            Width = grid.Width;
+            Height = grid.Height;
+            Colors = grid.Colors;
+            std::copy(grid.Data(), grid.Data() + grid.DataLength(), Allocate(nullptr));
+            History = grid.History;
+            Score = grid.Score;
+            Hash = grid.Hash;
+        }
+
         return *this;
     }
 
     CompactGrid& CompactGrid::operator=(CompactGrid&& grid) noexcept
     {
-        Width = grid.Width;
-        Height = grid.Height;
-        Data = std::move(grid.Data);
-        Solution = std::move(grid.Solution);
+        if (this != &grid)
+        {
+            Free();
+            Width = grid.Width;
+            Height = grid.Height;
+            Colors = grid.Colors;
+            std::copy(std::begin(grid.inlineData), std::end(grid.inlineData), inlineData);
+            History = grid.History;
+            Score = grid.Score;
+            Hash = grid.Hash;
+            dataInArena = grid.dataInArena;
+            grid.Width = 0;
+            grid.Height = 0;
+        }
+
         return *this;
     }
 
-    std::size_t CompactGrid::DataLength() const
+    CompactGrid::~CompactGrid()
     {
-        return (Width * Height * 3 + 7) / 8;
+        Free();
     }
 
-    Grid CompactGrid::Expand() const
+    // Returns the storage for the block data, given that Width, Height and Colors are already set.
+    // Data that does not fit inline is allocated from arena if one is given, otherwise on the heap.
+    std::byte* CompactGrid::Allocate(BumpArena* arena)
     {
-        Grid grid(Width, Height);
-        grid.Solution = Solution;
+        dataInArena = false;
 
-        Block* blocks = grid.BlocksBegin();
+        if (IsInline())
+            return inlineData;
 
-        for (int i = 0; i + 7 < Width * Height; i += 8)
+        if (arena != nullptr)
         {
-            const std::byte* b = &Data[i / 8 * 3];
-            blocks[i] = static_cast<Block>(b[0] & std::byte{ 0b111 });
-            blocks[i + 1] = static_cast<Block>((b[0] >> 3) & std::byte{ 0b111 });
-            blocks[i + 2] = static_cast<Block>(((b[0] >> 5) & std::byte{ 0b110 }) | (b[1] & std::byte{ 0b001 }));
-            blocks[i + 3] = static_cast<Block>((b[1] >> 1) & std::byte{ 0b111 });
-            blocks[i + 4] = static_cast<Block>((b[1] >> 4) & std::byte{ 0b111 });
-            blocks[i + 5] = static_cast<Block>(((b[1] >> 5) & std::byte{ 0b100 }) | (b[2] & std::byte{ 0b011 }));
-            blocks[i + 6] = static_cast<Block>((b[2] >> 2) & std::byte{ 0b111 });
-            blocks[i + 7] = static_cast<Block>((b[2] >> 5) & std::byte{ 0b111 });
+            dataInArena = true;
+            heapData = arena->Allocate(DataLength());
         }
+        else
+            heapData = new std::byte[DataLength()];
+
+        return heapData;
+    }
+
+    void CompactGrid::Free()
+    {
+        if (!IsInline() && !dataInArena)
+            delete[] heapData;
+    }
+
+    unsigned int CompactGrid::BitsPerBlock() const
+    {
+        int numColors = std::popcount(Colors);
+        return numColors <= 1 ? 1 : numColors <= 3 ? 2 : 3;
+    }
 
-        for (int i = Width * Height - (Width * Height % 8); i < Width * Height; i++)
+    std::size_t CompactGrid::DataLength() const
+    {
+        return (Width * Height * BitsPerBlock() + 7) / 8;
+    }
+
+    unsigned int CompactGrid::GetNumberOfBlocks() const
+    {
+        // Every 8 blocks take up bitsPerBlock bytes, with empty blocks and the unused bits at the end being zero.
+        // The bits of every block are folded into its lowest bit, and the blocks of 8 at a time are counted at once.
+        const std::byte* data = Data();
+        std::size_t dataLength = DataLength();
+        unsigned int bitsPerBlock = BitsPerBlock();
+        std::uint32_t lowestBits = bitsPerBlock == 1 ? 0xFF : bitsPerBlock == 2 ? 0x5555 : 0x249249;
+        unsigned int numBlocks = 0;
+
+        for (std::size_t i = 0; i < dataLength; i += bitsPerBlock)
         {
-            const std::byte* b = &Data[i / 8 * 3];
-            switch (i % 8)
-            {
-            case 0:
-                blocks[i] = static_cast<Block>(b[0] & std::byte{ 0b111 });
-                break;
-            case 1:
-                blocks[i] = static_cast<Block>((b[0] >> 3) & std::byte{ 0b111 });
-                break;
-            case 2:
-                blocks[i] = static_cast<Block>(((b[0] >> 5) & std::byte{ 0b110 }) | (b[1] & std::byte{ 0b001 }));
-                break;
-            case 3:
-                blocks[i] = static_cast<Block>((b[1] >> 1) & std::byte{ 0b111 });
-                break;
-            case 4:
-                blocks[i] = static_cast<Block>((b[1] >> 4) & std::byte{ 0b111 });
-                break;
-            case 5:
-                blocks[i] = static_cast<Block>(((b[1] >> 5) & std::byte{ 0b100 }) | (b[2] & std::byte{ 0b011 }));
-                break;
-            case 6:
-                blocks[i] = static_cast<Block>((b[2] >> 2) & std::byte{ 0b111 });
-                break;
-            case 7:
-                blocks[i] = static_cast<Block>((b[2] >> 5) & std::byte{ 0b111 });
-                break;
-            }
+            std::uint32_t bits = 0;
+            for (std::size_t j = 0; j < bitsPerBlock && i + j < dataLength; j++)
+                bits |= static_cast<std::uint32_t>(data[i + j]) << (j * 8);
+
+            if (bitsPerBlock == 2)
+                bits |= bits >> 1;
+            else if (bitsPerBlock == 3)
+                bits |= (bits >> 1) | (bits >> 2);
+
+            numBlocks += std::popcount(bits & lowestBits);
         }
 
-        return grid;
+        return numBlocks;
     }
 
-    void CompactGrid::Compact(const Grid& grid)
+    Grid CompactGrid::Expand() const
     {
-        Data = std::make_unique_for_overwrite<std::byte[]>(DataLength());
+        Grid grid(Width, Height);
 
-        const Block* blocks = grid.BlocksBegin();
+        unsigned int bitsPerBlock = BitsPerBlock();
 
-        for (int i = 0; i + 7 < Width * Height; i += 8)
+        if (bitsPerBlock == 3)
+            UnpackBlocks(Data(), Width * Height, grid.BlocksBegin());
+        else
         {
-            std::byte* b = &Data[i / 8 * 3];
-            b[0] = static_cast<std::byte>(blocks[i]);
-            b[0] |= static_cast<std::byte>(blocks[i + 1]) << 3;
-            b[0] |= (static_cast<std::byte>(blocks[i + 2]) & std::byte{ 0b110 }) << 5;
-            b[1] = static_cast<std::byte>(blocks[i + 2]) & std::byte{ 0b001 };
-            b[1] |= static_cast<std::byte>(blocks[i + 3]) << 1;
-            b[1] |= static_cast<std::byte>(blocks[i + 4]) << 4;
-            b[1] |= (static_cast<std::byte>(blocks[i + 5]) & std::byte{ 0b100 }) << 5;
-            b[2] = static_cast<std::byte>(blocks[i + 5]) & std::byte{ 0b011 };
-            b[2] |= static_cast<std::byte>(blocks[i + 6]) << 2;
-            b[2] |= static_cast<std::byte>(blocks[i + 7]) << 5;
+            std::array<Block, 4> blocksByCode{};
+            unsigned int code = 1;
+            for (unsigned int color = 1; color < 8; color++)
+                if (Colors & (1u << color))
+                    blocksByCode[code++] = static_cast<Block>(color);
+
+            UnpackBlockCodes(Data(), Width * Height, bitsPerBlock, blocksByCode, grid.BlocksBegin());
         }
 
-        for (int i = Width * Height - (Width * Height % 8); i < Width * Height; i++)
+        return grid;
+    }
+
+    void CompactGrid::Compact(const Grid& grid, BumpArena* arena)
+    {
+        Colors = GetBlockColors(grid.BlocksBegin(), Width * Height) & ~1u;
+
+        std::byte* data = Allocate(arena);
+
+        unsigned int bitsPerBlock = BitsPerBlock();
+
+        if (bitsPerBlock == 3)
+            PackBlocks(grid.BlocksBegin(), Width * Height, data);
+        else
         {
-            std::byte* b = &Data[i / 8 * 3];
-            switch (i % 8)
-            {
-            case 0:
-                b[0] = static_cast<std::byte>(blocks[i]);
-                break;
-            case 1:
-                b[0] |= static_cast<std::byte>(blocks[i]) << 3;
-                break;
-            case 2:
-                b[0] |= (static_cast<std::byte>(blocks[i]) & std::byte{ 0b110 }) << 5;
-                b[1] = static_cast<std::byte>(blocks[i]) & std::byte{ 0b001 };
-                break;
-            case 3:
-                b[1] |= static_cast<std::byte>(blocks[i]) << 1;
-                break;
-            case 4:
-                b[1] |= static_cast<std::byte>(blocks[i]) << 4;
-                break;
-            case 5:
-                b[1] |= (static_cast<std::byte>(blocks[i]) & std::byte{ 0b100 }) << 5;
-                b[2] = static_cast<std::byte>(blocks[i]) & std::byte{ 0b011 };
-                break;
-            case 6:
-                b[2] |= static_cast<std::byte>(blocks[i]) << 2;
-                break;
-            case 7:
-                b[2] |= static_cast<std::byte>(blocks[i]) << 5;
-                break;
-            }
+            std::array<unsigned char, 8> codes{};
+            unsigned char code = 1;
+            for (unsigned int color = 1; color < 8; color++)
+                if (Colors & (1u << color))
+                    codes[color] = code++;
+
+            PackBlockCodes(grid.BlocksBegin(), Width * Height, bitsPerBlock, codes, data);
         }
     }
+
+    bool CompareContents(const CompactGrid& a, const CompactGrid& b)
+    {
+        if (a.Width != b.Width || a.Height != b.Height || a.Colors != b.Colors)
+            return std::tie(a.Width, a.Height, a.Colors) < std::tie(b.Width, b.Height, b.Colors);
+
+        return std::lexicographical_compare(a.Data(), a.Data() + a.DataLength(), b.Data(), b.Data() + b.DataLength());
+    }
 }
\ No newline at end of file
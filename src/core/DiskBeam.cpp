@@ -0,0 +1,421 @@
+#include "core/DiskBeam.h"
+
+#include <algorithm>
+#include <execution>
+#include <format>
+#include <fstream>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+
+#include "core/BumpArena.h"
+
+namespace
+{
+    // runs are merged at most this many at a time, so that the number of open files stays bounded
+    constexpr std::size_t MaxMergeWidth = 64;
+    // file buffers of every run that is read or written
+    constexpr std::size_t MinBufferSize = 1 << 12;
+    constexpr std::size_t MaxBufferSize = 1 << 20;
+
+#pragma pack(push, 1)
+    // Precedes the block data of every grid in a run. Runs only live as long as the search,
+    // so they are written in the native byte order.
+    struct RecordHeader
+    {
+        unsigned char Width;
+        unsigned char Height;
+        unsigned char Colors;
+        sgbust::MoveLink History;
+        int ScoreValue;
+        float ScoreObjective;
+        std::uint32_t Hash;
+        std::uint16_t DataLength;
+    };
+#pragma pack(pop)
+
+    bool HashLess(const sgbust::CompactGrid& a, const sgbust::CompactGrid& b)
+    {
+        return a.Hash < b.Hash || (a.Hash == b.Hash && CompareContents(a, b));
+    }
+
+    bool ScoreLess(const sgbust::CompactGrid& a, const sgbust::CompactGrid& b)
+    {
+        if (a.Score < b.Score)
+            return true;
+        return !(b.Score < a.Score) && CompareContents(a, b);
+    }
+}
+
+namespace sgbust
+{
+    class DiskBeam::RunWriter
+    {
+        std::filesystem::path path;
+        std::vector<char> buffer;
+        std::ofstream file;
+
+    public:
+        RunWriter(const std::filesystem::path& path, std::size_t bufferSize) : path(path), buffer(bufferSize)
+        {
+            file.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+            file.open(path, std::ios_base::binary);
+            if (!file)
+                throw std::runtime_error(std::format("Could not create file {}", path.string()));
+        }
+
+        void Write(const CompactGrid& grid)
+        {
+            RecordHeader header{ grid.Width, grid.Height, grid.Colors, grid.History, grid.Score.Value, grid.Score.Objective, grid.Hash, static_cast<std::uint16_t>(grid.DataLength()) };
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            file.write(reinterpret_cast<const char*>(grid.Data()), header.DataLength);
+        }
+
+        void Close()
+        {
+            file.close();
+            if (file.fail())
+                throw std::runtime_error(std::format("Could not write to file {}", path.string()));
+        }
+    };
+
+    class DiskBeam::RunReader
+    {
+        std::filesystem::path path;
+        std::vector<char> buffer;
+        std::ifstream file;
+        std::vector<std::byte> data;
+
+    public:
+        // the grid read last
+        CompactGrid Grid;
+
+        RunReader(const std::filesystem::path& path, std::size_t bufferSize) : path(path), buffer(bufferSize)
+        {
+            file.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+            file.open(path, std::ios_base::binary);
+            if (!file)
+                throw std::runtime_error(std::format("Could not open file {}", path.string()));
+        }
+
+        // Reads the next grid, returns false at the end of the run
+        bool Next()
+        {
+            RecordHeader header;
+            if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)))
+            {
+                if (file.eof() && file.gcount() == 0)
+                    return false;
+                throw std::runtime_error(std::format("Could not read from file {}", path.string()));
+            }
+
+            data.resize(header.DataLength);
+            if (!file.read(reinterpret_cast<char*>(data.data()), header.DataLength))
+                throw std::runtime_error(std::format("Could not read from file {}", path.string()));
+
+            Grid = CompactGrid(header.Width, header.Height, header.Colors, data.data(), header.Hash, Score(header.ScoreValue, header.ScoreObjective), header.History);
+            return true;
+        }
+    };
+
+    DiskBeam::DiskBeam(std::filesystem::path directory) : parentDirectory(std::move(directory))
+    {
+    }
+
+    DiskBeam::~DiskBeam()
+    {
+        Clear();
+    }
+
+    std::filesystem::path DiskBeam::CreateRun()
+    {
+        // every beam gets a directory of its own, so that several searches can share the same parent directory
+        if (!directory.has_value())
+        {
+            std::random_device random;
+            while (!directory.has_value())
+            {
+                std::filesystem::path path = parentDirectory / std::format("sgbust-{:08x}{:08x}", random(), random());
+                if (std::filesystem::create_directories(path))
+                    directory = path;
+            }
+        }
+
+        return *directory / std::format("{}.run", numRunsCreated++);
+    }
+
+    void DiskBeam::OpenRuns(const std::vector<std::filesystem::path>& runs, std::size_t count, std::size_t bufferSize, bool byHash,
+        std::vector<std::unique_ptr<RunReader>>& readers, std::vector<RunReader*>& heap)
+    {
+        for (std::size_t i = 0; i < count; i++)
+        {
+            std::unique_ptr<RunReader>& reader = readers.emplace_back(std::make_unique<RunReader>(runs[i], bufferSize));
+            if (reader->Next())
+                heap.push_back(reader.get());
+        }
+
+        if (byHash)
+            std::make_heap(heap.begin(), heap.end(), [](const RunReader* a, const RunReader* b) { return HashLess(b->Grid, a->Grid); });
+        else
+            std::make_heap(heap.begin(), heap.end(), [](const RunReader* a, const RunReader* b) { return ScoreLess(b->Grid, a->Grid); });
+    }
+
+    void DiskBeam::MergeHashRuns(std::size_t count, std::size_t bufferSize, const std::function<void(CompactGrid&)>& f)
+    {
+        std::vector<std::unique_ptr<RunReader>> hashReaders;
+        std::vector<RunReader*> heap;
+        OpenRuns(hashRuns, count, bufferSize, true, hashReaders, heap);
+
+        auto greater = [](const RunReader* a, const RunReader* b) { return HashLess(b->Grid, a->Grid); };
+
+        // identical grids follow each other, of which the one with the better score or the lesser history is passed on
+        std::optional<CompactGrid> grid;
+
+        while (!heap.empty())
+        {
+            std::pop_heap(heap.begin(), heap.end(), greater);
+            RunReader* reader = heap.back();
+
+            if (grid.has_value() && std::equal_to<CompactGrid>()(reader->Grid, *grid))
+            {
+                if (reader->Grid.Score < grid->Score || (!(grid->Score < reader->Grid.Score) && reader->Grid.History < grid->History))
+                {
+                    grid->Score = reader->Grid.Score;
+                    grid->History = reader->Grid.History;
+                }
+            }
+            else
+            {
+                if (grid.has_value())
+                    f(*grid);
+                grid = std::move(reader->Grid);
+            }
+
+            if (reader->Next())
+                std::push_heap(heap.begin(), heap.end(), greater);
+            else
+                heap.pop_back();
+        }
+
+        if (grid.has_value())
+            f(*grid);
+
+        hashReaders.clear();
+        for (std::size_t i = 0; i < count; i++)
+            std::filesystem::remove(hashRuns[i]);
+        hashRuns.erase(hashRuns.begin(), hashRuns.begin() + count);
+    }
+
+    void DiskBeam::MergeScoreRuns(std::size_t count, std::size_t bufferSize)
+    {
+        std::vector<std::unique_ptr<RunReader>> scoreReaders;
+        std::vector<RunReader*> heap;
+        OpenRuns(scoreRuns, count, bufferSize, false, scoreReaders, heap);
+
+        auto greater = [](const RunReader* a, const RunReader* b) { return ScoreLess(b->Grid, a->Grid); };
+
+        std::filesystem::path run = CreateRun();
+        RunWriter writer(run, bufferSize);
+
+        while (!heap.empty())
+        {
+            std::pop_heap(heap.begin(), heap.end(), greater);
+            RunReader* reader = heap.back();
+
+            writer.Write(reader->Grid);
+
+            if (reader->Next())
+                std::push_heap(heap.begin(), heap.end(), greater);
+            else
+                heap.pop_back();
+        }
+
+        writer.Close();
+
+        scoreReaders.clear();
+        for (std::size_t i = 0; i < count; i++)
+            std::filesystem::remove(scoreRuns[i]);
+        scoreRuns.erase(scoreRuns.begin(), scoreRuns.begin() + count);
+        scoreRuns.push_back(run);
+    }
+
+    void DiskBeam::Spill(const Beam& beam)
+    {
+        std::vector<const CompactGrid*> grids;
+        grids.reserve(beam.MergedSize());
+        beam.ForEach([&](const CompactGrid& grid) { grids.push_back(&grid); });
+
+        if (grids.empty())
+            return;
+
+        std::sort(std::execution::par, grids.begin(), grids.end(), [](const CompactGrid* a, const CompactGrid* b) {
+            return HashLess(*a, *b);
+            });
+
+        std::filesystem::path run = CreateRun();
+        RunWriter writer(run, MaxBufferSize);
+        for (const CompactGrid* grid : grids)
+            writer.Write(*grid);
+        writer.Close();
+
+        hashRuns.push_back(run);
+    }
+
+    void DiskBeam::Finish(std::size_t memory, std::optional<std::size_t> maxSize, const std::function<void(const MoveLink&)>& addHistory)
+    {
+        // a quarter of the memory goes to the buffers of the runs that are merged, the rest to sorting by score
+        std::size_t bufferSize = std::clamp(memory / 4 / MaxMergeWidth, MinBufferSize, MaxBufferSize);
+        std::size_t sortMemory = memory - memory / 4;
+
+        while (hashRuns.size() > MaxMergeWidth)
+        {
+            std::filesystem::path run = CreateRun();
+            RunWriter writer(run, bufferSize);
+            MergeHashRuns(MaxMergeWidth, bufferSize, [&](CompactGrid& grid) { writer.Write(grid); });
+            writer.Close();
+            hashRuns.push_back(run);
+        }
+
+        // Number of grids by score, of which all but the best maxSize grids are dropped. Since the runs are free of duplicates
+        // once they are merged, the limit is the score at which the grids seen so far reach the maximum size,
+        // and grids with worse scores are not even written.
+        std::map<Score, std::size_t> counts;
+        std::map<Score, std::size_t>::iterator limit = counts.end();
+        std::size_t numUpToLimit = 0;
+
+        std::vector<CompactGrid> sortedGrids;
+        BumpArena sortedArena;
+        std::size_t sortedSize = 0;
+
+        auto writeSortedGrids = [&]() {
+            std::sort(std::execution::par, sortedGrids.begin(), sortedGrids.end(), ScoreLess);
+
+            std::filesystem::path run = CreateRun();
+            RunWriter writer(run, bufferSize);
+            for (const CompactGrid& grid : sortedGrids)
+            {
+                if (limit != counts.end() && limit->first < grid.Score)
+                    break;
+                writer.Write(grid);
+            }
+            writer.Close();
+
+            scoreRuns.push_back(run);
+            sortedGrids.clear();
+            sortedArena.Reset();
+            sortedSize = 0;
+        };
+
+        MergeHashRuns(hashRuns.size(), bufferSize, [&](CompactGrid& grid) {
+            if (limit != counts.end() && limit->first < grid.Score)
+                return;
+
+            auto it = counts.try_emplace(grid.Score, 0).first;
+            it->second++;
+
+            if (limit != counts.end())
+            {
+                numUpToLimit++;
+                while (limit != counts.begin() && numUpToLimit - limit->second >= *maxSize)
+                    numUpToLimit -= (limit--)->second;
+            }
+            else if (maxSize.has_value() && ++numUpToLimit >= *maxSize)
+                limit = std::prev(counts.end());
+
+            addHistory(grid.History);
+            sortedSize += sizeof(CompactGrid) + (grid.DataLength() > CompactGrid::InlineCapacity ? grid.DataLength() : 0);
+            sortedGrids.emplace_back(grid, sortedArena);
+
+            if (sortedSize >= sortMemory)
+                writeSortedGrids();
+            });
+
+        if (!sortedGrids.empty())
+            writeSortedGrids();
+
+        while (scoreRuns.size() > MaxMergeWidth)
+            MergeScoreRuns(MaxMergeWidth, bufferSize);
+
+        // grids beyond the limit that were written before the limit was reached come last and are never read
+        if (limit != counts.end())
+            counts.erase(std::next(limit), counts.end());
+
+        buckets.clear();
+        size = 0;
+        for (auto [score, count] : counts)
+        {
+            buckets.push_back(Beam::Bucket{ score, size, size + count });
+            size += count;
+        }
+
+        // grids are dropped from the beginning of the last bucket that is kept, as with Beam::Trim
+        if (maxSize.has_value() && size > *maxSize)
+        {
+            Beam::Bucket& bucket = buckets.back();
+            std::size_t numDropped = size - *maxSize;
+            dropBegin = bucket.Begin;
+            dropEnd = bucket.Begin + numDropped;
+            bucket.End -= numDropped;
+            size = *maxSize;
+        }
+    }
+
+    bool DiskBeam::ReadGrids(std::vector<CompactGrid>& grids, BumpArena& arena, std::size_t maxBytes)
+    {
+        if (readers.empty() && !scoreRuns.empty())
+            OpenRuns(scoreRuns, scoreRuns.size(), std::clamp(maxBytes / scoreRuns.size(), MinBufferSize, MaxBufferSize), false, readers, readerHeap);
+
+        auto greater = [](const RunReader* a, const RunReader* b) { return ScoreLess(b->Grid, a->Grid); };
+
+        std::size_t bytes = 0;
+        bool read = false;
+
+        while (numRead < size && bytes < maxBytes)
+        {
+            std::pop_heap(readerHeap.begin(), readerHeap.end(), greater);
+            RunReader* reader = readerHeap.back();
+
+            if (position < dropBegin || position >= dropEnd)
+            {
+                bytes += sizeof(CompactGrid) + (reader->Grid.DataLength() > CompactGrid::InlineCapacity ? reader->Grid.DataLength() : 0);
+                grids.emplace_back(reader->Grid, arena);
+                numRead++;
+                read = true;
+            }
+
+            position++;
+
+            if (reader->Next())
+                std::push_heap(readerHeap.begin(), readerHeap.end(), greater);
+            else
+                readerHeap.pop_back();
+        }
+
+        return read;
+    }
+
+    void DiskBeam::Clear()
+    {
+        readerHeap.clear();
+        readers.clear();
+
+        // files that cannot be removed are left behind rather than failing the search
+        if (directory.has_value())
+        {
+            std::error_code error;
+            std::filesystem::remove_all(*directory, error);
+            directory.reset();
+        }
+
+        hashRuns.clear();
+        scoreRuns.clear();
+        buckets.clear();
+        size = 0;
+        dropBegin = 0;
+        dropEnd = 0;
+        position = 0;
+        numRead = 0;
+    }
+}
\ No newline at end of file
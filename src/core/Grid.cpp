@@ -3,25 +3,43 @@
 #include <algorithm>
 #include <iostream>
 #include <iterator>
-#include <limits>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <tuple>
 #include <utility>
+#include <vector>
 
 namespace
 {
-    static constexpr char BlockVisited = 0b10000000;
+    // Returns a per-thread array of visit marks with at least the given number of entries and a mark value
+    // that no entry has been set to yet. Each flood fill uses a new mark value so the array never needs to be reset.
+    std::tuple<unsigned int*, unsigned int> GetVisitedMarks(std::size_t size)
+    {
+        static thread_local std::vector<unsigned int> marks;
+        static thread_local unsigned int mark = 0;
+
+        if (marks.size() < size)
+            marks.resize(size);
+
+        if (++mark == 0)
+        {
+            std::fill(marks.begin(), marks.end(), 0);
+            mark = 1;
+        }
+
+        return std::make_tuple(marks.data(), mark);
+    }
 }
 
 namespace sgbust
 {
-    Grid::Grid(unsigned char width, unsigned char height) : Width(width), Height(height), Blocks(std::make_unique<Block[]>(width* height))
+    Grid::Grid(unsigned char width, unsigned char height) : Width(width), Height(height), Blocks(std::make_unique<Block[]>(width* height)), capacity(width * height)
     {
     }
 
     Grid::Grid(unsigned char width, unsigned char height, const Block* blocks, sgbust::Solution solution)
-        : Width(width), Height(height), Blocks(std::make_unique_for_overwrite<Block[]>(width* height)), Solution(std::move(solution))
+        : Width(width), Height(height), Blocks(std::make_unique_for_overwrite<Block[]>(width* height)), Solution(std::move(solution)), capacity(width * height)
     {
         std::copy(blocks, blocks + Width * Height, BlocksBegin());
     }
@@ -51,6 +69,7 @@ namespace sgbust
             throw std::runtime_error("Invalid Bloc Grid File: minimal group size out-of-range.");
 
         Blocks = std::make_unique_for_overwrite<Block[]>(Width * Height);
+        capacity = Width * Height;
 
         stream.read(reinterpret_cast<char*>(Blocks.get()), Width * Height);
 
@@ -59,7 +78,7 @@ namespace sgbust
     }
 
     Grid::Grid(const Grid& grid)
-        : Width(grid.Width), Height(grid.Height), Solution(grid.Solution)
+        : Width(grid.Width), Height(grid.Height), Solution(grid.Solution), capacity(grid.Width * grid.Height)
     {
         Blocks = std::make_unique_for_overwrite<Block[]>(Width * Height);
 
@@ -67,14 +86,18 @@ namespace sgbust
     }
 
     Grid::Grid(Grid&& grid) noexcept
-        : Width(grid.Width), Height(grid.Height), Blocks(std::move(grid.Blocks)), Solution(std::move(grid.Solution))
+        : Width(grid.Width), Height(grid.Height), Blocks(std::move(grid.Blocks)), Solution(std::move(grid.Solution)), capacity(grid.capacity)
     {
+        grid.capacity = 0;
     }
 
     Grid& Grid::operator=(const Grid& grid)
     {
-        if (Width * Height < grid.Width * grid.Height || Blocks == nullptr)
+        if (capacity < grid.Width * grid.Height || Blocks == nullptr)
+        {
             Blocks = std::make_unique_for_overwrite<Block[]>(grid.Width * grid.Height);
+            capacity = grid.Width * grid.Height;
+        }
 
         Width = grid.Width;
         Height = grid.Height;
@@ -91,6 +114,8 @@ namespace sgbust
         Height = grid.Height;
         Blocks = std::move(grid.Blocks);
         Solution = std::move(grid.Solution);
+        capacity = grid.capacity;
+        grid.capacity = 0;
 
         return *this;
     }
@@ -108,33 +133,159 @@ namespace sgbust
             throw std::runtime_error("Could not save Grid to stream");
     }
 
-    void Grid::GetGroups(std::vector<Group>& groups, unsigned int minGroupSize) const
+    void Grid::GetGroups(GroupList& groups, unsigned int minGroupSize) const
     {
-        auto blocks = const_cast<Grid*>(this)->BlocksView();
+        auto blocks = BlocksView();
+        auto [visited, visitedMark] = GetVisitedMarks(Width * Height);
 
         groups.clear();
-        groups.reserve(24);
+        groups.positions.resize(Width * Height);
+        groups.entries.reserve(24);
 
-        static thread_local Group adjacentBlocks;
-        adjacentBlocks.reserve(Width * Height);
+        unsigned int numPositions = 0;
 
         for (unsigned char y = 0; y < Height; y++)
             for (unsigned char x = 0; x < Width; x++)
-                if ((static_cast<char>(blocks(x, y)) & BlockVisited) == 0 && blocks(x, y) != Block::None)
+                if (visited[x + y * Width] != visitedMark && blocks(x, y) != Block::None)
                 {
                     if (minGroupSize > 1)
                         if (x != Width - 1 && y != Height - 1 && blocks(x, y) != blocks(x + 1, y) && blocks(x, y) != blocks(x, y + 1))
                             continue;
 
-                    adjacentBlocks.clear();
-                    GetAdjacentBlocksRecursive(blocks, adjacentBlocks, x, y);
+                    Group group = FillGroup(groups.positions.data() + numPositions, visited, visitedMark, x, y);
 
-                    if (adjacentBlocks.size() >= minGroupSize)
-                        groups.emplace_back(adjacentBlocks);                    
+                    if (group.size() >= minGroupSize)
+                    {
+                        groups.entries.push_back({ numPositions, static_cast<unsigned int>(group.size()), group.Left, group.Right, group.Top, group.Bottom });
+                        numPositions += group.size();
+                    }
                 }
 
-        for (auto it = const_cast<Grid*>(this)->BlocksBegin(), end = const_cast<Grid*>(this)->BlocksEnd(); it != end; it++)
-            reinterpret_cast<char&>(*it) &= ~BlockVisited;
+        groups.positions.resize(numPositions);
+    }
+
+    // Computes the groups of a grid that resulted from removing the given group from oldGrid, based on the groups of oldGrid.
+    // Only the part of the grid that was changed by the removal is relabeled, all other groups are carried over.
+    // The resulting list is identical to the one returned by GetGroups(groups, minGroupSize).
+    void Grid::GetGroups(GroupList& groups, unsigned int minGroupSize, const Grid& oldGrid, const GroupList& oldGroups, std::size_t removedGroupIndex) const
+    {
+        Group removedGroup = oldGroups[removedGroupIndex];
+
+        int left = removedGroup.Left;
+        int right = removedGroup.Right;
+        int bottom = removedGroup.Bottom;
+        bool columnsCollapsed = Width != oldGrid.Width;
+        int rowsRemoved = oldGrid.Height - Height;
+
+        // blocks of oldGrid that were moved by the removal or are adjacent to moved blocks,
+        // any group containing none of them is unchanged apart from a possible vertical shift
+        auto isAffected = [&](int x, int y) {
+            if (columnsCollapsed)
+                return x >= left - 1;
+            else
+                return (x >= left - 1 && x <= right + 1 && y <= bottom) || (x >= left && x <= right && y == bottom + 1);
+        };
+
+        groups.clear();
+        groups.positions.resize(Width * Height);
+        groups.entries.reserve(oldGroups.size());
+
+        unsigned int numPositions = 0;
+
+        for (std::size_t i = 0; i < oldGroups.size(); i++)
+        {
+            if (i == removedGroupIndex)
+                continue;
+
+            Group group = oldGroups[i];
+
+            bool boundsAffected = columnsCollapsed ?
+                group.Right + 1 >= left :
+                group.Right + 1 >= left && group.Left <= right + 1 && group.Top <= bottom + 1;
+            if (boundsAffected && std::ranges::any_of(group, [&](Position p) { return isAffected(p.X, p.Y); }))
+                continue;
+
+            Position* positions = groups.positions.data() + numPositions;
+            if (rowsRemoved == 0)
+                std::ranges::copy(group, positions);
+            else
+                for (Position p : group)
+                    *positions++ = Position(p.X, p.Y - rowsRemoved);
+
+            groups.entries.push_back({ numPositions, static_cast<unsigned int>(group.size()), group.Left, group.Right,
+                static_cast<unsigned char>(group.Top - rowsRemoved), static_cast<unsigned char>(group.Bottom - rowsRemoved) });
+            numPositions += group.size();
+        }
+
+        // retained groups keep their relative order, so only the relabeled groups need to be sorted and merged in
+        static thread_local std::vector<GroupList::Entry> newEntries;
+        newEntries.clear();
+
+        auto blocks = BlocksView();
+        auto [visited, visitedMark] = GetVisitedMarks(Width * Height);
+
+        int scanBottom = columnsCollapsed ? Height - 1 : std::min(bottom + 1 - rowsRemoved, Height - 1);
+
+        for (int y = 0; y <= scanBottom; y++)
+        {
+            // the affected blocks of the row, in coordinates of the new grid
+            int scanLeft = std::max(left - 1, 0);
+            int scanRight = columnsCollapsed ? Width - 1 : std::min(right + 1, Width - 1);
+            if (!columnsCollapsed && y + rowsRemoved == bottom + 1)
+            {
+                scanLeft = left;
+                scanRight = std::min(right, Width - 1);
+            }
+
+            for (int x = scanLeft; x <= scanRight; x++)
+            {
+                if (visited[x + y * Width] == visitedMark || blocks(x, y) == Block::None)
+                    continue;
+
+                if (minGroupSize > 1)
+                {
+                    Block block = blocks(x, y);
+                    if ((x == 0 || blocks(x - 1, y) != block) && (y == 0 || blocks(x, y - 1) != block) &&
+                        (x == Width - 1 || blocks(x + 1, y) != block) && (y == Height - 1 || blocks(x, y + 1) != block))
+                        continue;
+                }
+
+                Group group = FillGroup(groups.positions.data() + numPositions, visited, visitedMark, x, y);
+
+                if (group.size() >= minGroupSize)
+                {
+                    // groups are ordered by their top-left block which is always stored first
+                    Position* positions = groups.positions.data() + numPositions;
+                    std::iter_swap(positions, std::ranges::min_element(positions, positions + group.size(), [](Position a, Position b) {
+                        return a.Y < b.Y || (a.Y == b.Y && a.X < b.X);
+                        }));
+
+                    newEntries.push_back({ numPositions, static_cast<unsigned int>(group.size()), group.Left, group.Right, group.Top, group.Bottom });
+                    numPositions += group.size();
+                }
+            }
+        }
+
+        groups.positions.resize(numPositions);
+
+        auto isBefore = [&](const GroupList::Entry& a, const GroupList::Entry& b) {
+            Position pa = groups.positions[a.Offset];
+            Position pb = groups.positions[b.Offset];
+            return pa.Y < pb.Y || (pa.Y == pb.Y && pa.X < pb.X);
+        };
+
+        std::ranges::sort(newEntries, isBefore);
+
+        std::size_t numRetained = groups.entries.size();
+        groups.entries.resize(numRetained + newEntries.size());
+
+        auto retained = groups.entries.begin() + numRetained;
+        auto dest = groups.entries.end();
+        for (auto added = newEntries.end(); added != newEntries.begin();)
+            if (retained != groups.entries.begin() && isBefore(added[-1], retained[-1]))
+                *--dest = *--retained;
+            else
+                *--dest = *--added;
     }
 
     bool Grid::HasGroups(unsigned int minGroupSize) const
@@ -142,74 +293,101 @@ namespace sgbust
         if (minGroupSize <= 1)
             return !IsEmpty();
 
-        auto blocks = const_cast<Grid*>(this)->BlocksView();
+        auto blocks = BlocksView();
+
+        // for the common case of groups of at least two blocks, it suffices to look for two adjacent blocks of the same color
+        if (minGroupSize == 2)
+        {
+            for (unsigned char y = 0; y < Height; y++)
+                for (unsigned char x = 0; x < Width; x++)
+                {
+                    Block block = blocks(x, y);
+                    if (block == Block::None)
+                        continue;
+                    if ((x != Width - 1 && blocks(x + 1, y) == block) || (y != Height - 1 && blocks(x, y + 1) == block))
+                        return true;
+                }
+
+            return false;
+        }
 
-        static thread_local Group adjacentBlocks;
-        adjacentBlocks.reserve(Width * Height);
+        auto [visited, visitedMark] = GetVisitedMarks(Width * Height);
 
-        bool hasGroups = false;
+        static thread_local std::vector<Position> adjacentBlocks;
+        adjacentBlocks.resize(Width * Height);
 
         for (unsigned char y = 0; y < Height; y++)
             for (unsigned char x = 0; x < Width; x++)
-                if ((static_cast<char>(blocks(x, y)) & BlockVisited) == 0 && blocks(x, y) != Block::None)
+                if (visited[x + y * Width] != visitedMark && blocks(x, y) != Block::None)
                 {
                     if (x != Width - 1 && y != Height - 1 && blocks(x, y) != blocks(x + 1, y) && blocks(x, y) != blocks(x, y + 1))
                         continue;
 
-                    adjacentBlocks.clear();
-                    GetAdjacentBlocksRecursive(blocks, adjacentBlocks, x, y);
-
-                    if (adjacentBlocks.size() >= minGroupSize)
-                    {
-                        hasGroups = true;
-                        goto exit;
-                    }
+                    if (FillGroup(adjacentBlocks.data(), visited, visitedMark, x, y, minGroupSize).size() >= minGroupSize)
+                        return true;
                 }
 
-    exit:
-        for (auto it = const_cast<Grid*>(this)->BlocksBegin(), end = const_cast<Grid*>(this)->BlocksEnd(); it != end; it++)
-            reinterpret_cast<char&>(*it) &= ~BlockVisited;
-
-        return hasGroups;
+        return false;
     }
 
-    void Grid::GetAdjacentBlocksRecursive(BlocksSpan blocks, Group& group, unsigned char x, unsigned char y)
+    Group Grid::FillGroup(Position* positions, unsigned int* visited, unsigned int visitedMark, unsigned char x, unsigned char y, unsigned int maxSize) const
     {
-        group.emplace_back(x, y);
-
-        Block color = blocks(x, y);
+        const Block* blocks = Blocks.get();
+        unsigned int width = Width;
+        unsigned int height = Height;
+        Block color = blocks[x + y * width];
+
+        positions[0] = Position(x, y);
+        visited[x + y * width] = visitedMark;
+        unsigned int size = 1;
+
+        unsigned char left = x;
+        unsigned char right = x;
+        unsigned char top = y;
+        unsigned char bottom = y;
+
+        // the positions of the group double as the queue of the flood fill, so no separate stack is needed
+        for (unsigned int i = 0; i < size && size < maxSize; i++)
+        {
+            unsigned int px = positions[i].X;
+            unsigned int py = positions[i].Y;
+            unsigned int index = px + py * width;
 
-        reinterpret_cast<char&>(blocks(x, y)) |= BlockVisited;
+            auto visit = [&](unsigned int neighbor, unsigned int nx, unsigned int ny) {
+                if (visited[neighbor] != visitedMark && blocks[neighbor] == color)
+                {
+                    visited[neighbor] = visitedMark;
+                    positions[size++] = Position(nx, ny);
+                    left = std::min<unsigned char>(left, nx);
+                    right = std::max<unsigned char>(right, nx);
+                    top = std::min<unsigned char>(top, ny);
+                    bottom = std::max<unsigned char>(bottom, ny);
+                }
+            };
+
+            if (px > 0)
+                visit(index - 1, px - 1, py);
+            if (py > 0)
+                visit(index - width, px, py - 1);
+            if (px < width - 1)
+                visit(index + 1, px + 1, py);
+            if (py < height - 1)
+                visit(index + width, px, py + 1);
+        }
 
-        if (x > 0 && blocks(x - 1, y) == color)
-            GetAdjacentBlocksRecursive(blocks, group, x - 1, y);
-        if (y > 0 && blocks(x, y - 1) == color)
-            GetAdjacentBlocksRecursive(blocks, group, x, y - 1);
-        if (x < blocks.extent(0) - 1 && blocks(x + 1, y) == color)
-            GetAdjacentBlocksRecursive(blocks, group, x + 1, y);
-        if (y < blocks.extent(1) - 1 && blocks(x, y + 1) == color)
-            GetAdjacentBlocksRecursive(blocks, group, x, y + 1);
+        return Group{ std::span(positions, size), left, right, top, bottom };
     }
 
     void Grid::RemoveGroup(const Group& group)
     {
         auto blocks = BlocksView();
 
-        int left = std::numeric_limits<int>::max();
-        int right = std::numeric_limits<int>::min();
-        int bottom = std::numeric_limits<int>::min();
+        int left = group.Left;
+        int right = group.Right;
+        int bottom = group.Bottom;
 
         for (auto [x, y] : group)
-        {
-            if (x < left)
-                left = x;
-            if (x > right)
-                right = x;
-            if (y > bottom)
-                bottom = y;
-
             blocks(x, y) = Block::None;
-        }
 
         for (int x = left; x <= right; x++)
         {
@@ -253,24 +431,41 @@ namespace sgbust
         Block* firstBlock = std::find_if(BlocksBegin(), BlocksEnd(), [](auto b) { return b != Block::None; });
         int newHeight = Height - std::distance(BlocksBegin(), firstBlock) / Width;
 
+        // the grid is shrunk in place, every block moves to a lower index so it is never overwritten before being moved
         if (newWidth != Width || newHeight != Height)
         {
-            std::unique_ptr<Block[]> newBlocks = std::make_unique_for_overwrite<Block[]>(newWidth * newHeight);
-            BlocksSpan newBlocksView(newBlocks.get(), newWidth, newHeight);
+            BlocksSpan newBlocksView(Blocks.get(), newWidth, newHeight);
 
             if (newWidth != Width)
                 for (int y = 0; y < newHeight; y++)
                     for (int x = 0; x < newWidth; x++)
                         newBlocksView(x, y) = blocks(x, (Height - newHeight) + y);
             else
-                std::copy(&blocks(0, Height - newHeight), BlocksEnd(), newBlocks.get());
+                std::copy(&blocks(0, Height - newHeight), BlocksEnd(), Blocks.get());
 
             Width = newWidth;
             Height = newHeight;
-            Blocks = std::move(newBlocks);
         }
     }
 
+    // Replaces the blocks of this grid by those of the given grid with the given group removed.
+    // The existing block storage is reused if it is large enough. Solution is left unchanged.
+    void Grid::RemoveGroup(const Grid& grid, const Group& group)
+    {
+        if (capacity < grid.Width * grid.Height || Blocks == nullptr)
+        {
+            Blocks = std::make_unique_for_overwrite<Block[]>(grid.Width * grid.Height);
+            capacity = grid.Width * grid.Height;
+        }
+
+        Width = grid.Width;
+        Height = grid.Height;
+
+        std::copy(grid.BlocksBegin(), grid.BlocksEnd(), BlocksBegin());
+
+        RemoveGroup(group);
+    }
+
     unsigned int Grid::GetNumberOfBlocks() const
     {
         return std::count_if(BlocksBegin(), BlocksEnd(), [](auto c) { return c != Block::None; });
@@ -298,8 +493,8 @@ namespace sgbust
     {
         unsigned int length = solution.GetLength();
 
-        std::vector<Group> groups;
-        
+        GroupList groups;
+
         for (unsigned int i = 0; i < length; i++)
         {
             GetGroups(groups, minGroupSize);
@@ -318,6 +513,11 @@ namespace sgbust
     {
         auto blocks = BlocksView();
 
+        std::vector<bool> highlighted(Width * Height);
+        if (highlightedGroup != nullptr)
+            for (auto [x, y] : *highlightedGroup)
+                highlighted[x + y * Width] = true;
+
         std::ostringstream output;
 
         for (int y = 0; y < Height; y++)
@@ -356,7 +556,7 @@ namespace sgbust
                     throw std::out_of_range("Unexpected block color value");
                 }
 
-                if (highlightedGroup != nullptr && std::ranges::find(*highlightedGroup, Position(x, y)) != highlightedGroup->end())
+                if (highlighted[x + y * Width])
                     output << "\x1B[30;1m" << colorCode << "[]";
 				else
                     output << colorCode << "  ";
@@ -0,0 +1,159 @@
+#include "core/GridHash.h"
+
+#include <algorithm>
+#include <array>
+
+namespace
+{
+    constexpr std::uint32_t Multiplier = 0x9E3779B1;
+
+    constexpr std::uint32_t GetInverse(std::uint32_t x)
+    {
+        // Newton's method for odd numbers modulo 2^32, every iteration doubles the number of correct bits
+        std::uint32_t inverse = x;
+        for (int i = 0; i < 5; i++)
+            inverse *= 2 - x * inverse;
+        return inverse;
+    }
+
+    constexpr std::array<std::uint32_t, 256> GetPowers(std::uint32_t x)
+    {
+        std::array<std::uint32_t, 256> powers{};
+        std::uint32_t power = 1;
+        for (std::uint32_t& p : powers)
+        {
+            p = power;
+            power *= x;
+        }
+        return powers;
+    }
+
+    constexpr std::array<std::uint32_t, 256> Powers = GetPowers(Multiplier);
+    constexpr std::array<std::uint32_t, 256> InversePowers = GetPowers(GetInverse(Multiplier));
+
+    // Hashes the blocks of a column from the bottom up, skipping empty cells, and counts them
+    std::uint32_t HashColumn(const sgbust::Grid& grid, unsigned int x, unsigned int& numBlocks)
+    {
+        auto blocks = grid.BlocksView();
+
+        std::uint32_t hash = 0x811C9DC5;
+        numBlocks = 0;
+
+        for (int y = grid.Height - 1; y >= 0; y--)
+            if (blocks(x, y) != sgbust::Block::None)
+            {
+                hash = (hash ^ static_cast<std::uint32_t>(blocks(x, y))) * 0x01000193;
+                numBlocks++;
+            }
+
+        // finalizer of MurmurHash3, so that the weighted sum of the columns is well distributed
+        hash ^= hash >> 16;
+        hash *= 0x85EBCA6B;
+        hash ^= hash >> 13;
+        hash *= 0xC2B2AE35;
+        hash ^= hash >> 16;
+        return hash;
+    }
+}
+
+namespace sgbust
+{
+    std::uint32_t HashGrid(const Grid& grid)
+    {
+        std::uint32_t hash = 0;
+        unsigned int index = 0;
+
+        for (unsigned int x = 0; x < grid.Width; x++)
+        {
+            unsigned int numBlocks;
+            std::uint32_t columnHash = HashColumn(grid, x, numBlocks);
+            if (numBlocks != 0)
+                hash += columnHash * Powers[index++];
+        }
+
+        return hash;
+    }
+
+    std::uint32_t UpdateGridHash(std::uint32_t oldHash, const Grid& oldGrid, const Group& group, const Grid& newGrid)
+    {
+        // The index of a column among the non-empty columns is its position as long as no column is empty,
+        // which only grids read from files may violate. Those are hashed in full.
+        auto oldBlocks = oldGrid.BlocksView();
+        for (unsigned int x = 0; x < oldGrid.Width; x++)
+            if (oldBlocks(x, oldGrid.Height - 1) == Block::None)
+                return HashGrid(newGrid);
+
+        std::array<unsigned char, 256> groupBlocks;
+        std::fill(groupBlocks.begin() + group.Left, groupBlocks.begin() + group.Right + 1, 0);
+        for (auto [x, y] : group)
+            groupBlocks[x]++;
+
+        // the columns of the group are replaced by those that still have blocks left, which keep their order
+        std::uint32_t hash = oldHash;
+        std::uint32_t oldGroupColumns = 0;
+        unsigned int newX = group.Left;
+
+        for (unsigned int x = group.Left; x <= group.Right; x++)
+        {
+            unsigned int numBlocks;
+            std::uint32_t oldColumn = HashColumn(oldGrid, x, numBlocks) * Powers[x];
+            oldGroupColumns += oldColumn;
+            hash -= oldColumn;
+
+            if (numBlocks > groupBlocks[x])
+            {
+                hash += HashColumn(newGrid, newX, numBlocks) * Powers[newX];
+                newX++;
+            }
+        }
+
+        // the columns to the right of the group move to the left by the number of columns that were cleared,
+        // their weights are divided accordingly after their sum is computed from the side with fewer columns
+        unsigned int shift = group.Right + 1 - newX;
+        if (shift != 0)
+        {
+            std::uint32_t tail = 0;
+            unsigned int numBlocks;
+
+            if (oldGrid.Width - 1u - group.Right <= group.Left)
+                for (unsigned int x = group.Right + 1; x < oldGrid.Width; x++)
+                    tail += HashColumn(oldGrid, x, numBlocks) * Powers[x];
+            else
+            {
+                std::uint32_t head = 0;
+                for (unsigned int x = 0; x < group.Left; x++)
+                    head += HashColumn(oldGrid, x, numBlocks) * Powers[x];
+                tail = oldHash - head - oldGroupColumns;
+            }
+
+            hash += tail * InversePowers[shift] - tail;
+        }
+
+        return hash;
+    }
+
+    std::uint32_t FingerprintGrid(const Grid& grid)
+    {
+        auto blocks = grid.BlocksView();
+
+        // 64-bit FNV-1a over the blocks of every non-empty column from the bottom up, each followed by an end marker
+        std::uint64_t hash = 0xCBF29CE484222325;
+
+        for (unsigned int x = 0; x < grid.Width; x++)
+        {
+            bool empty = true;
+
+            for (int y = grid.Height - 1; y >= 0; y--)
+                if (blocks(x, y) != Block::None)
+                {
+                    hash = (hash ^ static_cast<std::uint64_t>(blocks(x, y))) * 0x100000001B3;
+                    empty = false;
+                }
+
+            if (!empty)
+                hash = (hash ^ 0xFF) * 0x100000001B3;
+        }
+
+        return static_cast<std::uint32_t>(hash ^ (hash >> 32));
+    }
+}
\ No newline at end of file
@@ -0,0 +1,144 @@
+#include "core/GridTable.h"
+
+#include <algorithm>
+#include <bit>
+#include <new>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <xmmintrin.h>
+#endif
+
+namespace sgbust
+{
+    GridTable::~GridTable()
+    {
+        Clear();
+    }
+
+    std::size_t GridTable::GetSlot(const CompactGrid& grid) const
+    {
+        // Fibonacci hashing, the upper bits of the product depend on all bits of the hash
+        return static_cast<std::size_t>((grid.Hash * 0x9E3779B97F4A7C15ull) >> (64 - capacityBits));
+    }
+
+    std::size_t GridTable::GetCapacity(std::size_t numGrids)
+    {
+        // the load factor is kept at 3/4 at most
+        return std::max(std::bit_ceil(numGrids + numGrids / 3 + 1), MinCapacity);
+    }
+
+    bool GridTable::Reserve(std::size_t numGrids)
+    {
+        std::size_t newCapacity = GetCapacity(numGrids);
+        if (newCapacity <= capacity)
+            return false;
+
+        std::unique_ptr<std::atomic<std::uint32_t>[]> oldTags = std::move(tags);
+        std::unique_ptr<std::byte[]> oldStorage = std::move(storage);
+        CompactGrid* oldRecords = records;
+        std::size_t oldCapacity = capacity;
+
+        tags = std::make_unique<std::atomic<std::uint32_t>[]>(newCapacity);
+        storage = std::make_unique_for_overwrite<std::byte[]>(newCapacity * sizeof(CompactGrid));
+        records = reinterpret_cast<CompactGrid*>(storage.get());
+        capacity = newCapacity;
+        capacityBits = std::countr_zero(newCapacity);
+
+        // records are moved to their new slots, their block data stays where it is
+        for (std::size_t i = 0; i < oldCapacity; i++)
+        {
+            std::uint32_t tag = oldTags[i].load(std::memory_order_relaxed);
+            if (tag == EmptyTag)
+                continue;
+
+            std::size_t slot = GetSlot(oldRecords[i]);
+            while (tags[slot].load(std::memory_order_relaxed) != EmptyTag)
+                slot = (slot + 1) & (capacity - 1);
+
+            new (&records[slot]) CompactGrid(std::move(oldRecords[i]));
+            tags[slot].store(tag, std::memory_order_relaxed);
+            oldRecords[i].~CompactGrid();
+        }
+
+        return Size() != 0;
+    }
+
+    void GridTable::Shrink(std::size_t numGrids)
+    {
+        if (Size() == 0 && capacity > GetCapacity(numGrids) * ShrinkFactor)
+            Clear();
+    }
+
+    void GridTable::Prefetch(const CompactGrid& grid) const
+    {
+        if (capacity == 0)
+            return;
+
+        std::size_t slot = GetSlot(grid);
+#if defined(__GNUC__) || defined(__clang__)
+        __builtin_prefetch(&tags[slot]);
+        __builtin_prefetch(&records[slot]);
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+        _mm_prefetch(reinterpret_cast<const char*>(&tags[slot]), _MM_HINT_T0);
+        _mm_prefetch(reinterpret_cast<const char*>(&records[slot]), _MM_HINT_T0);
+#endif
+    }
+
+    std::pair<CompactGrid*, bool> GridTable::Insert(const CompactGrid& grid, BumpArena& arena)
+    {
+        std::uint32_t tag = GetTag(grid);
+
+        for (std::size_t slot = GetSlot(grid); ; slot = (slot + 1) & (capacity - 1))
+        {
+            std::uint32_t slotTag = tags[slot].load(std::memory_order_acquire);
+
+            if (slotTag == EmptyTag)
+            {
+                if (tags[slot].compare_exchange_strong(slotTag, BusyTag, std::memory_order_acquire))
+                {
+                    new (&records[slot]) CompactGrid(grid, arena);
+                    tags[slot].store(tag, std::memory_order_release);
+                    size.fetch_add(1, std::memory_order_relaxed);
+                    return { &records[slot], true };
+                }
+
+                // another thread claimed the slot first, which may have been for an identical grid
+            }
+
+            while (slotTag == BusyTag)
+                slotTag = tags[slot].load(std::memory_order_acquire);
+
+            if (slotTag == tag && std::equal_to<CompactGrid>()(records[slot], grid))
+                return { &records[slot], false };
+        }
+    }
+
+    void GridTable::Reset()
+    {
+        if (Size() == 0)
+            return;
+
+        for (std::size_t i = 0; i < capacity; i++)
+        {
+            if (tags[i].load(std::memory_order_relaxed) != EmptyTag)
+            {
+                records[i].~CompactGrid();
+                tags[i].store(EmptyTag, std::memory_order_relaxed);
+            }
+        }
+
+        size.store(0, std::memory_order_relaxed);
+    }
+
+    void GridTable::Clear()
+    {
+        ForEach([](CompactGrid& grid) { grid.~CompactGrid(); });
+
+        tags.reset();
+        storage.reset();
+        records = nullptr;
+        capacity = 0;
+        capacityBits = 0;
+        size.store(0, std::memory_order_relaxed);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,114 @@
+#include "core/MoveHistory.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace sgbust
+{
+    void MoveHistory::Clear()
+    {
+        tables.clear();
+        numEntries = 0;
+    }
+
+    void MoveHistory::BeginDepth(std::size_t maxNodes)
+    {
+        tables.emplace_back(maxNodes);
+        numEntries = 0;
+    }
+
+    std::uint32_t MoveHistory::Add(const MoveLink& link)
+    {
+        std::uint32_t index = numEntries.fetch_add(1, std::memory_order_relaxed);
+        tables.back()[index] = link;
+        return index;
+    }
+
+    void MoveHistory::Add(std::uint32_t index, const MoveLink& link)
+    {
+        tables.back()[index] = link;
+
+        // the table ends after the highest index recorded
+        std::uint32_t count = numEntries.load(std::memory_order_relaxed);
+        while (count <= index)
+            if (numEntries.compare_exchange_weak(count, index + 1, std::memory_order_relaxed))
+                break;
+    }
+
+    void MoveHistory::EndDepth()
+    {
+        tables.back().resize(numEntries);
+    }
+
+    void MoveHistory::Prune(std::vector<char>& live)
+    {
+        // live marks the entries of the newest table that the beam leads to. The newest table itself is pruned
+        // at the next depth. Older tables are compacted from new to old until one without unused entries is found,
+        // since all tables older than that one have already been compacted before.
+        std::vector<char> olderLive;
+        std::vector<std::uint32_t> remap;
+
+        for (std::size_t k = tables.size() - 1; k > 0; k--)
+        {
+            std::vector<MoveLink>& table = tables[k];
+            std::vector<MoveLink>& olderTable = tables[k - 1];
+
+            olderLive.assign(olderTable.size(), 0);
+            for (std::size_t i = 0; i < table.size(); i++)
+                if (live[i])
+                    olderLive[table[i].Parent] = 1;
+
+            if (std::all_of(olderLive.begin(), olderLive.end(), [](char l) { return l != 0; }))
+                break;
+
+            remap.resize(olderTable.size());
+            std::uint32_t numLive = 0;
+            for (std::size_t i = 0; i < olderTable.size(); i++)
+                if (olderLive[i])
+                {
+                    remap[i] = numLive;
+                    olderTable[numLive++] = olderTable[i];
+                }
+
+            olderTable.resize(numLive);
+            olderTable.shrink_to_fit();
+
+            for (std::size_t i = 0; i < table.size(); i++)
+                if (live[i])
+                    table[i].Parent = remap[table[i].Parent];
+
+            live.assign(numLive, 1);
+        }
+    }
+
+    Solution MoveHistory::GetSolution(const MoveLink& link) const
+    {
+        std::vector<unsigned char> steps;
+
+        MoveLink current = link;
+        std::size_t k = tables.size();
+
+        while (current.Parent != MoveLink::NoParent)
+        {
+            steps.push_back(current.Move);
+            current = tables[--k][current.Parent];
+        }
+
+        std::reverse(steps.begin(), steps.end());
+        return Solution(steps);
+    }
+
+    void MoveHistory::Restore(std::vector<std::vector<MoveLink>> tables)
+    {
+        this->tables = std::move(tables);
+        numEntries = 0;
+    }
+
+    std::size_t MoveHistory::GetNumberOfEntries() const
+    {
+        std::size_t count = 0;
+        for (const std::vector<MoveLink>& table : tables)
+            count += table.size();
+        return count;
+    }
+}
\ No newline at end of file
@@ -6,7 +6,7 @@
 
 namespace sgbust
 {
-    Solution::Solution(std::string_view string)
+    Solution::Solution(std::string_view string) : length(0)
     {
         if (string.empty())
             return;
@@ -35,54 +35,86 @@ namespace sgbust
                 throw std::invalid_argument("Invalid solution string");
         }
 
-        this->steps = std::make_unique_for_overwrite<unsigned char[]>(steps.size() + 1);
-        std::copy(steps.begin(), steps.end(), this->steps.get());
-        this->steps.get()[steps.size()] = 0xFF;
+        if (steps.size() > 0xFFFF)
+            throw std::invalid_argument("Solution is too long");
+
+        std::copy(steps.begin(), steps.end(), Allocate(steps.size()));
     }
 
-    Solution::Solution(const Solution& solution)
+    Solution::Solution(const std::vector<unsigned char>& steps) : length(0)
     {
-        if (solution.steps != nullptr)
-        {
-            int length = solution.GetLength();
-            steps = std::make_unique_for_overwrite<unsigned char[]>(length + 1);
-            std::copy(solution.steps.get(), solution.steps.get() + length + 1, steps.get());
-        }
+        if (steps.size() > 0xFFFF)
+            throw std::invalid_argument("Solution is too long");
+
+        std::copy(steps.begin(), steps.end(), Allocate(steps.size()));
+    }
+
+    Solution::Solution(const Solution& solution) : length(0)
+    {
+        std::copy(solution.Steps(), solution.Steps() + solution.length, Allocate(solution.length));
+    }
+
+    Solution::Solution(Solution&& solution) noexcept : length(solution.length)
+    {
+        std::copy(std::begin(solution.inlineSteps), std::end(solution.inlineSteps), inlineSteps);
+        solution.length = 0;
     }
 
     Solution& Solution::operator=(const Solution& solution)
     {
-        if (solution.steps != nullptr)
+        if (this != &solution)
         {
-            int length = solution.GetLength();
-            steps = std::make_unique_for_overwrite<unsigned char[]>(length + 1);
-            std::copy(solution.steps.get(), solution.steps.get() + length + 1, steps.get());
+            Free();
+            std::copy(solution.Steps(), solution.Steps() + solution.length, Allocate(solution.length));
         }
-        else
-            steps = nullptr;
 
         return *this;
     }
 
-    Solution Solution::Append(unsigned char step) const
+    Solution& Solution::operator=(Solution&& solution) noexcept
     {
-        Solution result;
-
-        if (steps != nullptr)
-        {
-            int length = GetLength();
-            result.steps = std::make_unique_for_overwrite<unsigned char[]>(length + 2);
-            std::copy(steps.get(), steps.get() + length, result.steps.get());
-            result.steps[length] = step;
-            result.steps[length + 1] = 0xFF;
-        }
-        else
+        if (this != &solution)
         {
-            result.steps = std::make_unique_for_overwrite<unsigned char[]>(2);
-            result.steps[0] = step;
-            result.steps[1] = 0xFF;
+            Free();
+            length = solution.length;
+            std::copy(std::begin(solution.inlineSteps), std::end(solution.inlineSteps), inlineSteps);
+            solution.length = 0;
         }
 
+        return *this;
+    }
+
+    Solution::~Solution()
+    {
+        Free();
+    }
+
+    // Sets the length of the solution, which must be empty, and returns the storage for its steps
+    unsigned char* Solution::Allocate(unsigned int length)
+    {
+        this->length = length;
+
+        if (IsInline())
+            return inlineSteps;
+
+        heapSteps = new unsigned char[length];
+        return heapSteps;
+    }
+
+    void Solution::Free()
+    {
+        if (!IsInline())
+            delete[] heapSteps;
+
+        length = 0;
+    }
+
+    Solution Solution::Append(unsigned char step) const
+    {
+        Solution result;
+        unsigned char* steps = result.Allocate(length + 1);
+        std::copy(Steps(), Steps() + length, steps);
+        steps[length] = step;
         return result;
     }
 
@@ -95,49 +127,32 @@ namespace sgbust
         else
         {
             Solution result;
-            unsigned int length1 = GetLength();
-            unsigned int length2 = solution.GetLength();
-            result.steps = std::make_unique_for_overwrite<unsigned char[]>(length1 + length2 + 1);
-            std::copy(steps.get(), steps.get() + length1, result.steps.get());
-            std::copy(solution.steps.get(), solution.steps.get() + length2, result.steps.get() + length1);
-            result.steps[length1 + length2] = 0xFF;
+            unsigned char* steps = result.Allocate(length + solution.length);
+            std::copy(Steps(), Steps() + length, steps);
+            std::copy(solution.Steps(), solution.Steps() + solution.length, steps + length);
             return result;
         }
     }
 
     std::string Solution::AsString() const
     {
-        if (steps == nullptr)
-            return std::string();
-
         std::string solution;
 
-        for (unsigned char* step = steps.get(); *step != 0xFF; step++)
+        for (unsigned int i = 0; i < length; i++)
         {
-            if (*step < 26)
-                solution.push_back((char)(*step + 65));
+            unsigned char step = Steps()[i];
+
+            if (step < 26)
+                solution.push_back((char)(step + 65));
             else
             {
                 solution.push_back('(');
-                solution.push_back((char)((*step / 26) + 64));
-                solution.push_back((char)((*step % 26) + 65));
+                solution.push_back((char)((step / 26) + 64));
+                solution.push_back((char)((step % 26) + 65));
                 solution.push_back(')');
             }
         }
 
         return solution;
     }
-
-    unsigned int Solution::GetLength() const
-    {
-        if (steps == nullptr)
-            return 0;
-
-        int length = 0;
-
-        while (steps[length] != 0xFF)
-            length++;
-
-        return length;
-    }
 }
\ No newline at end of file
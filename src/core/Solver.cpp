@@ -1,23 +1,29 @@
 #include "core/Solver.h"
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
-#include <cmath>
 #include <condition_variable>
+#include <deque>
+#include <exception>
 #include <execution>
 #include <format>
+#include <future>
 #include <iomanip>
 #include <iostream>
-#include <iterator>
+#include <limits>
 #include <mutex>
 #include <numeric>
 #include <ranges>
+#include <span>
 #include <stop_token>
 #include <thread>
 #include <utility>
 #include <vector>
 
+#include "core/Checkpoint.h"
 #include "core/CompactGrid.h"
+#include "core/GridHash.h"
 #include "core/MemoryUsage.h"
 
 namespace sgbust
@@ -28,17 +34,18 @@ namespace sgbust
         {
             Grid oldGrid = grid;
             unsigned char step = solution[i];
-            std::vector<Group> groups;
+            GroupList groups;
             grid.GetGroups(groups, minGroupSize);
             if (step >= groups.size())
                 throw std::invalid_argument("Solution string is not valid for this grid");
             grid.RemoveGroup(groups[step]);
-            score = scoring.RemoveGroup(score, oldGrid, groups[step], grid, minGroupSize);
+            score = scoring.RemoveGroup(score, oldGrid, groups, step, grid, minGroupSize);
         }
     }
 
     std::optional<SolverResult> Solver::Solve(const Grid& grid, unsigned int minGroupSize, const Scoring& scoring, const Solution& solutionPrefix)
     {
+        startTime = std::chrono::steady_clock::now();
         this->minGroupSize = minGroupSize;
         this->scoring = &scoring;
         this->solutionPrefix = solutionPrefix;
@@ -49,43 +56,118 @@ namespace sgbust
         if (!solutionPrefix.IsEmpty())
             ApplySolution(gridWithPrefix, initialScore, minGroupSize, solutionPrefix, scoring);
 
-        grids.clear();
-        grids[initialScore].insert(CompactGrid(gridWithPrefix));
+        if (SpillDirectory.has_value() && !MaxMemory.has_value())
+            throw std::invalid_argument("Spilling beams to disk requires a memory limit");
+
+        if (Resume && !CheckpointFile.has_value())
+            throw std::invalid_argument("Resuming a search requires a checkpoint file");
+
+        // the transposition table is not stored in checkpoints, so a resumed search would prune differently
+        if (Resume && TranspositionTableSize.has_value())
+            throw std::invalid_argument("Resuming a search is not supported with a transposition table");
+
+        grids->Clear();
+        newGrids->Clear();
+        grids->SetDeterministic(Deterministic);
+        newGrids->SetDeterministic(Deterministic);
+        grids->SetHashTable(HashTable);
+        newGrids->SetHashTable(HashTable);
+        arena->Clear();
+        newArena->Clear();
+        if (SpillDirectory.has_value())
+        {
+            spilledGrids = std::make_unique<DiskBeam>(*SpillDirectory);
+            newSpilledGrids = std::make_unique<DiskBeam>(*SpillDirectory);
+        }
+        else
+        {
+            spilledGrids.reset();
+            newSpilledGrids.reset();
+        }
+        history.Clear();
+        // the table is allocated before the baseline memory is measured, as it takes up the same memory throughout the search
+        transpositions.reset();
+        if (TranspositionTableSize.has_value())
+            transpositions = std::make_unique<TranspositionTable>(*TranspositionTableSize);
+        transpositionLookups = 0;
+        transpositionHits = 0;
+        totalTranspositionLookups = 0;
+        totalTranspositionHits = 0;
+        mergedBeyondKept = 0;
+        pendingMemoryUsage = 0;
+        mergedGridsPerGrid = 0.0;
 
         origNumColors = gridWithPrefix.GetNumberOfColors();
+        depth = 0;
         solution = Solution();
         bestScore = std::nullopt;
+        bestLink = MoveLink();
+        bestDepth = 0;
+        perfectScoreFound = false;
         solutionGrid = std::nullopt;
         beamSize = 1;
 		gridsDiscarded = 0;
-        multiplier = 0;
+        startGrid = gridWithPrefix;
+        startScore = initialScore;
+        deadline = std::nullopt;
+        if (TimeLimit.has_value())
+            deadline = startTime + *TimeLimit;
+        deadlineReached = false;
+        secondsPerChild = 0.0;
+        childrenPerGrid = 0.0;
+        depthsLeft = 0.0;
+        recentLeadingGridBlocks.clear();
+
+        std::atomic_bool stop = false;
+
+        if (Resume)
+        {
+            baselineMemory = GetCurrentMemoryUsage().value_or(0);
+            ResumeFromCheckpoint(grid);
+        }
+        else
+        {
+            grids->Add(gridWithPrefix, HashGrid(gridWithPrefix), initialScore, MoveLink());
+            grids->Merge(*arena);
+            grids->Sort();
+            baselineMemory = GetCurrentMemoryUsage().value_or(0);
 
-        bool stop = false;
+            if (!gridWithPrefix.HasGroups(minGroupSize))
+                CheckSolution(gridWithPrefix, initialScore, MoveLink(), stop);
+        }
 
-        if (!gridWithPrefix.HasGroups(minGroupSize))
-            CheckSolution(gridWithPrefix, initialScore, stop);
+        lastCheckpoint = std::chrono::steady_clock::now();
 
         if (!Quiet)
-            PrintStats(0);
+            PrintStats(depth);
 
-        for (depth = 0; depth < MaxDepth || !MaxDepth; depth++)
+        for (; depth < MaxDepth || !MaxDepth; depth++)
         {
-            bool maxDepthReached = MaxDepth.has_value() && depth == *MaxDepth - 1;
-
-            if (TrimmingEnabled && !maxDepthReached)
-                TrimBeam();
-
             SolveDepth(stop);
 
             if (!Quiet)
                 PrintStats(depth + 1);
 
+            if (!stop && deadline.has_value() && std::chrono::steady_clock::now() >= *deadline)
+            {
+                deadlineReached = true;
+                stop = true;
+            }
+
             if (stop)
                 break;
         }
 
+        // a search that ran out of time still finishes the leading grid of its beam
+        if (deadlineReached)
+            CompleteLeadingGrid();
+
+        // the files of spilled beams are removed right away
+        spilledGrids.reset();
+        newSpilledGrids.reset();
+
         if (bestScore.has_value())
-            return SolverResult{ *bestScore, std::move(solution), std::move(*solutionGrid) };
+            return SolverResult{ *bestScore, std::move(solution), std::move(*solutionGrid), totalTranspositionLookups, totalTranspositionHits };
         else
             return std::nullopt;
     }
@@ -96,26 +178,33 @@ namespace sgbust
         int curMaxScore = 0;
         double curAvgScore = 0.0;
 
-        if (!grids.empty())
+        const std::vector<Beam::Bucket>& buckets = GetBuckets();
+
+        if (!buckets.empty())
         {
-            auto [minScore, maxScore] = std::ranges::minmax(grids | std::views::transform([](const auto& b) { return b.first.Value; }));
+            auto [minScore, maxScore] = std::ranges::minmax(buckets | std::views::transform([](const Beam::Bucket& b) { return b.Score.Value; }));
             curMinScore = minScore;
             curMaxScore = maxScore;
-            long long scoreSum = std::transform_reduce(grids.begin(), grids.end(), 0LL, std::plus<>(), [](auto& b) { return b.first.Value * b.second.size(); });
+            long long scoreSum = std::transform_reduce(buckets.begin(), buckets.end(), 0LL, std::plus<>(), [](const Beam::Bucket& b) { return b.Score.Value * static_cast<long long>(b.End - b.Begin); });
             curAvgScore = static_cast<double>(scoreSum) / beamSize;
         }
 
         std::string output = std::format(
-            "Depth: {:3}, grids: {:9}, hash sets: {:4}, discarded: {:9}, scores (min/avg/max): {}/{:.1f}/{}",
+            "Depth: {:3}, grids: {:9}, buckets: {:4}, discarded: {:9}, scores (min/avg/max): {}/{:.1f}/{}",
             depth,
             beamSize,
-            grids.size(),
+            buckets.size(),
 			gridsDiscarded,
             curMinScore,
             curAvgScore,
             curMaxScore
         );
 
+        output += std::format(", rehashes: {}", grids->GetNumRehashes());
+
+        if (transpositions)
+            output += std::format(", transpositions: {}/{}", transpositionHits.load(), transpositionLookups.load());
+
         std::optional<std::size_t> memoryUsage = GetCurrentMemoryUsage();
         if (memoryUsage.has_value())
             output += std::format(", memory: {}MB", (*memoryUsage / 1024 / 1024));
@@ -123,37 +212,37 @@ namespace sgbust
         std::cout << output << std::endl;
     }
 
-    void Solver::PrintProgress(const std::map<Score, GridHashSet>& newGrids, unsigned int gridsSolved, unsigned int newBeamSize, unsigned int newGridsDiscarded) const
+    void Solver::PrintProgress(const Beam& newGrids, unsigned int gridsSolved, unsigned int newBeamSize, unsigned int newGridsDiscarded) const
     {
-        int curMinScore = 0;
-        int curMaxScore = 0;
-        double curAvgScore = 0.0;
+        int curMinScore = std::numeric_limits<int>::max();
+        int curMaxScore = std::numeric_limits<int>::min();
+        long long scoreSum = 0;
+        std::size_t numGrids = 0;
+
+        // the grids of the next depth are only bucketed once it is complete
+        newGrids.ForEach([&](const CompactGrid& grid) {
+            curMinScore = std::min(curMinScore, grid.Score.Value);
+            curMaxScore = std::max(curMaxScore, grid.Score.Value);
+            scoreSum += grid.Score.Value;
+            numGrids++;
+            });
 
-        std::shared_lock lock(mutex);
-        std::size_t numHashSets = newGrids.size();
+        double curAvgScore = 0.0;
 
-        if (!newGrids.empty())
+        if (numGrids != 0)
+            curAvgScore = static_cast<double>(scoreSum) / numGrids;
+        else
         {
-            auto [minScore, maxScore] = std::ranges::minmax(newGrids | std::views::transform([](const auto& b) { return b.first.Value; }));
-            curMinScore = minScore;
-            curMaxScore = maxScore;
-            long long scoreSum = std::transform_reduce(newGrids.begin(), newGrids.end(), 0LL, std::plus<>(), [](auto& b) { return b.first.Value * b.second.size(); });
-            curAvgScore = static_cast<double>(scoreSum) / newBeamSize;
+            curMinScore = 0;
+            curMaxScore = 0;
         }
 
-        lock.unlock();
-
-        double percentProcessed = gridsSolved * 100.0 / beamSize;
-        double percentBeamSizeLimit = 0.0;
-        if (MaxBeamSize.has_value())
-            percentBeamSizeLimit = newBeamSize * 100.0 / *MaxBeamSize;
-        double progress = std::max(percentProcessed, percentBeamSizeLimit);
+        double progress = gridsSolved * 100.0 / beamSize;
 
         std::string output = std::format(
-            "Depth: {:3}, grids: {:9}, hash sets: {:4}, discarded: {:9}, scores (min/avg/max): {}/{:.1f}/{}",
+            "Depth: {:3}, grids: {:9}, discarded: {:9}, scores (min/avg/max): {}/{:.1f}/{}",
             depth + 1,
             newBeamSize,
-            numHashSets,
             newGridsDiscarded,
             curMinScore,
             curAvgScore,
@@ -174,10 +263,8 @@ namespace sgbust
         std::cout << "\x1b[2K\r" << std::flush;
     }
 
-    void Solver::SolveDepth(bool& stop)
+    void Solver::SolveDepth(std::atomic_bool& stop)
     {
-        std::map<Score, GridHashSet> newGrids;
-
         std::atomic_uint gridsSolved = 0;
         std::atomic_uint newBeamSize = 0;
 	    std::atomic_uint totalDiscarded = 0;
@@ -198,38 +285,277 @@ namespace sgbust
                             break;
                     }
 
-					PrintProgress(newGrids, gridsSolved, newBeamSize, totalDiscarded);
+					PrintProgress(*newGrids, gridsSolved, newBeamSize, totalDiscarded);
                 }
 
                 ClearProgress();
             });
 
-        for (auto it = grids.begin(); it != grids.end(); it = grids.erase(it))
+        auto depthStart = std::chrono::steady_clock::now();
+        transpositionLookups = 0;
+        transpositionHits = 0;
+        std::optional<unsigned int> leadingGridBlocks;
+        std::optional<std::size_t> beamWidth = GetBeamWidth();
+        newGrids->SetMaxSize(beamWidth);
+        // the hash sets are grown ahead of time for as many grids as the last depth suggests, so that they rarely grow during the depth
+        if (!spilledGrids)
         {
-            auto& [score, hashSet] = *it;
-
-            // std::for_each is a little bit faster here than hashSet.for_each but only MSVC supports parallel execution for it,
-            // therefore we fall back to hashSet.for_each for other compilers
-#ifdef _MSC_VER
-            std::for_each(std::execution::par, hashSet.begin(), hashSet.end(), [&](const CompactGrid& grid) {
-#else
-            hashSet.for_each(std::execution::par, [&](const CompactGrid& grid) {
-#endif
-                if (stop || (MaxBeamSize && newBeamSize >= MaxBeamSize))
-                    return;
-
-                auto [added, discarded] = SolveGrid(grid.Expand(), score, newGrids, stop);
-
-                newBeamSize += added;
-			    totalDiscarded += discarded;
-                gridsSolved++;
-
-                // overall, deallocation is faster if we deallocate the data inside CompactGrids here already
-                const_cast<CompactGrid&>(grid) = CompactGrid();
-            });
+            std::size_t expectedGrids = static_cast<std::size_t>(beamSize * mergedGridsPerGrid);
+            // a beam with a maximum size merges about as many more grids than it keeps as at the last depth
+            if (beamWidth.has_value())
+                expectedGrids = std::min(expectedGrids, *beamWidth + mergedBeyondKept);
+            newGrids->Reserve(expectedGrids);
+        }
+        // with a spill directory, the beam of the next depth is spilled to disk whenever it takes up more memory than this
+        std::size_t runMemory = spilledGrids ? GetRunMemory() : 0;
 
-            if (stop || (MaxBeamSize && newBeamSize >= MaxBeamSize))
-                break;
+        // once a checkpoint is due, the grids of this depth are written to it in the background while they are expanded
+        std::optional<CheckpointState> checkpointState;
+        if (CheckpointFile.has_value() && std::chrono::steady_clock::now() - lastCheckpoint >= CheckpointInterval)
+        {
+            checkpointState = GetCheckpointState();
+            lastCheckpoint = std::chrono::steady_clock::now();
+        }
+
+        history.BeginDepth(beamSize);
+
+        std::atomic_size_t numChildren = 0;
+
+        // Expanding grids and merging their children into the beam of the next depth form one pool of tasks for all threads.
+        // Grids are expanded in chunks in the order of their scores, and in rounds whose children are buffered in alternating
+        // slots of the beam, so that one round can be expanded while the previous one is merged partition by partition.
+        // Merging tightens the scores the beam admits, so merge tasks are taken first. The size of a round is chosen
+        // from the number of children per grid so far, such that the children fit into the pending buffers.
+        struct Round
+        {
+            std::size_t End;
+            unsigned int Slot;
+            std::size_t NumUnfinishedChunks = 0;
+            std::size_t NextPartition = 0;
+            std::size_t NumUnfinishedPartitions = Beam::NumPartitions;
+        };
+
+        // expands sortedGrids, which are the grids of the beam from firstIndex on
+        auto expand = [&](std::span<const CompactGrid* const> sortedGrids, std::size_t firstIndex) {
+            std::mutex poolMutex;
+            std::condition_variable poolCv;
+            // rounds that are not merged yet, oldest first
+            std::deque<Round> rounds;
+            unsigned int numRounds = 0;
+            std::size_t nextGrid = 0;
+            unsigned int numBusy = 0;
+            bool spilling = false;
+
+            auto work = [&](unsigned int) {
+                std::unique_lock lock(poolMutex);
+
+                while (true)
+                {
+                    // after a stop, the grids of the latest round that were not taken yet are skipped
+                    if (stop && !rounds.empty() && nextGrid < rounds.back().End)
+                        rounds.back().End = nextGrid;
+
+                    // the oldest round can be merged once all of its grids are expanded
+                    if (!spilling && !rounds.empty() && (rounds.size() > 1 || nextGrid == rounds.front().End) &&
+                        rounds.front().NumUnfinishedChunks == 0 && rounds.front().NextPartition < Beam::NumPartitions)
+                    {
+                        Round& round = rounds.front();
+                        std::size_t partition = round.NextPartition++;
+                        numBusy++;
+                        lock.unlock();
+
+                        newBeamSize += newGrids->MergePartition(partition, *newArena, round.Slot);
+
+                        lock.lock();
+                        numBusy--;
+                        if (--round.NumUnfinishedPartitions == 0)
+                        {
+                            newGrids->FinishMerge(round.Slot);
+                            rounds.pop_front();
+
+                            // Once the beam of the next depth takes up its share of the memory, its grids are spilled to disk.
+                            // Merges wait for that to finish, but grids are still expanded in the meantime.
+                            if (newSpilledGrids && newGrids->GetMergedMemoryUsage() + newArena->GetMemoryUsage() > runMemory)
+                            {
+                                spilling = true;
+                                numBusy++;
+                                lock.unlock();
+
+                                newSpilledGrids->Spill(*newGrids);
+                                newGrids->DropMerged();
+                                newArena->Reset();
+
+                                lock.lock();
+                                numBusy--;
+                                spilling = false;
+                            }
+                        }
+                        poolCv.notify_all();
+                        continue;
+                    }
+
+                    // with a time limit, the search stops once the deadline has passed, keeping the children found so far
+                    if (!stop && deadline.has_value() && std::chrono::steady_clock::now() >= *deadline)
+                    {
+                        // other threads read the flags without the lock, so the reason is set before the stop is published
+                        deadlineReached = true;
+                        stop = true;
+                    }
+
+                    bool roundOpen = !rounds.empty() && nextGrid < rounds.back().End;
+
+                    if (!stop && nextGrid < sortedGrids.size() && (roundOpen || rounds.size() < Beam::NumSlots))
+                    {
+                        if (!roundOpen)
+                        {
+                            std::size_t roundSize = MinRoundSize;
+                            if (gridsSolved > 0)
+                                roundSize = std::max<std::size_t>(MaxPendingGrids * gridsSolved / std::max<std::size_t>(numChildren, 1), MinRoundSize);
+                            rounds.push_back(Round{ std::min(nextGrid + roundSize, sortedGrids.size()), numRounds++ % Beam::NumSlots });
+                        }
+
+                        // rounds are only removed once their chunks are finished, so the reference stays valid
+                        Round& round = rounds.back();
+                        std::size_t begin = nextGrid;
+                        std::size_t end = std::min(begin + ChunkSize, round.End);
+                        nextGrid = end;
+                        round.NumUnfinishedChunks++;
+                        numBusy++;
+                        lock.unlock();
+
+                        for (std::size_t i = begin; i < end && !stop; i++)
+                        {
+                            const CompactGrid* grid = sortedGrids[i];
+
+                            // with deterministic results, the history index of a grid is its position in the beam,
+                            // which makes the links of children comparable
+                            std::uint32_t historyIndex;
+                            if (Deterministic)
+                            {
+                                historyIndex = static_cast<std::uint32_t>(firstIndex + i);
+                                history.Add(historyIndex, grid->History);
+                            }
+                            else
+                                historyIndex = history.Add(grid->History);
+                            Grid expandedGrid = grid->Expand();
+
+                            if (deadline.has_value() && firstIndex + i == 0)
+                                leadingGridBlocks = expandedGrid.GetNumberOfBlocks();
+
+                            auto [added, discarded] = SolveGrid(expandedGrid, grid->Hash, grid->Score, historyIndex, round.Slot, stop);
+
+                            numChildren += added;
+                            totalDiscarded += discarded;
+                            gridsSolved++;
+                        }
+
+                        lock.lock();
+                        numBusy--;
+                        round.NumUnfinishedChunks--;
+                        poolCv.notify_all();
+                        continue;
+                    }
+
+                    // no task is left and none can become available
+                    if (numBusy == 0)
+                        break;
+
+                    poolCv.wait(lock);
+                }
+            };
+
+            std::vector<unsigned int> workers(std::max(std::thread::hardware_concurrency(), 1u));
+            std::iota(workers.begin(), workers.end(), 0u);
+            std::for_each(std::execution::par, workers.begin(), workers.end(), work);
+        };
+
+        // A checkpoint that cannot be written, for example because the disk is full, is given up with a warning,
+        // as the search it is meant to protect can go on without it
+        auto tryCheckpoint = [&](auto&& write) {
+            try
+            {
+                write();
+                return true;
+            }
+            catch (const std::exception& ex)
+            {
+                std::cerr << "Warning: checkpoint not written: " << ex.what() << std::endl;
+                return false;
+            }
+        };
+
+        if (spilledGrids && spilledGrids->HasRuns())
+        {
+            // a spilled beam is read in batches, the next one while the current one is expanded
+            std::size_t batchMemory = runMemory / 4;
+            std::vector<CompactGrid> batch;
+            std::vector<CompactGrid> nextBatch;
+            std::unique_ptr<BumpArena> batchArena = std::make_unique<BumpArena>();
+            std::unique_ptr<BumpArena> nextBatchArena = std::make_unique<BumpArena>();
+            std::vector<const CompactGrid*> batchGrids;
+            std::size_t firstIndex = 0;
+            std::unique_ptr<CheckpointWriter> checkpoint;
+
+            spilledGrids->ReadGrids(batch, *batchArena, batchMemory);
+
+            while (!batch.empty() && !stop)
+            {
+                // the batch is written to the checkpoint and the next one is read by separate tasks, while the batch is expanded
+                std::future<void> checkpointing;
+                if (checkpointState.has_value())
+                    checkpointing = std::async(std::launch::async, [&]() {
+                        bool written = tryCheckpoint([&]() {
+                            if (!checkpoint)
+                                checkpoint = std::make_unique<CheckpointWriter>(*CheckpointFile, *checkpointState);
+                            for (const CompactGrid& grid : batch)
+                                checkpoint->Write(grid);
+                            });
+
+                        if (!written)
+                        {
+                            checkpoint.reset();
+                            checkpointState.reset();
+                        }
+                        });
+
+                std::future<bool> reading = std::async(std::launch::async, [&]() { return spilledGrids->ReadGrids(nextBatch, *nextBatchArena, batchMemory); });
+
+                batchGrids.resize(batch.size());
+                std::transform(batch.begin(), batch.end(), batchGrids.begin(), [](const CompactGrid& grid) { return &grid; });
+                expand(batchGrids, firstIndex);
+                firstIndex += batch.size();
+
+                reading.get();
+                // the batch is only replaced once it is written
+                if (checkpointing.valid())
+                    checkpointing.get();
+                std::swap(batch, nextBatch);
+                std::swap(batchArena, nextBatchArena);
+                nextBatch.clear();
+                nextBatchArena->Reset();
+            }
+
+            // the checkpoint is discarded if the search stopped before all grids were read
+            if (checkpoint && batch.empty())
+                tryCheckpoint([&]() { checkpoint->Commit(); });
+        }
+        else
+        {
+            std::future<void> checkpointing;
+            if (checkpointState.has_value())
+                checkpointing = std::async(std::launch::async, [&]() {
+                    tryCheckpoint([&]() {
+                        CheckpointWriter checkpoint(*CheckpointFile, *checkpointState);
+                        for (const CompactGrid* grid : grids->GetGrids())
+                            checkpoint.Write(*grid);
+                        checkpoint.Commit();
+                        });
+                    });
+
+            expand(grids->GetGrids(), 0);
+
+            if (checkpointing.valid())
+                checkpointing.get();
         }
 
         if (reporter.has_value())
@@ -238,41 +564,338 @@ namespace sgbust
             reporter->join();
         }
 
-        multiplier = static_cast<double>(newBeamSize) / gridsSolved;
+        // the beam of the next depth keeps exactly the best grids. It does not take any grids until the depth after
+        // the next one, so the memory for its pending grids is given back in the meantime
+        std::swap(grids, newGrids);
+        pendingMemoryUsage = grids->GetPendingMemoryUsage();
+        if (gridsSolved > 0)
+            mergedGridsPerGrid = static_cast<double>(grids->MergedSize()) / gridsSolved;
+        grids->ReleasePendingMemory();
+
+        // once the beam of the next depth has been spilled, the rest of it is spilled as well and it is merged on disk
+        bool spilled = newSpilledGrids && newSpilledGrids->HasRuns();
+        if (spilledGrids)
+        {
+            spilledGrids->Clear();
+            std::swap(spilledGrids, newSpilledGrids);
+        }
+        if (spilled)
+        {
+            spilledGrids->Spill(*grids);
+            grids->DropMerged();
+            newArena->Reset();
+        }
+
+        grids->Sort();
+        if (beamWidth.has_value())
+        {
+            mergedBeyondKept = grids->MergedSize() - std::min(grids->MergedSize(), *beamWidth);
+            grids->Trim(*beamWidth);
+        }
+
+        // The kept grids are recorded only once the depth is complete, so that lookups do not depend on the timing of the threads.
+        // Their blocks are counted and fingerprinted in parallel, but they are stored in sorted order, which decides the entries that are replaced.
+        if (transpositions && !spilled)
+        {
+            std::span<const CompactGrid* const> keptGrids = grids->GetGrids();
+            std::vector<std::pair<std::uint32_t, unsigned int>> fingerprints(keptGrids.size());
+            std::transform(std::execution::par, keptGrids.begin(), keptGrids.end(), fingerprints.begin(), [](const CompactGrid* grid) {
+                Grid expandedGrid = grid->Expand();
+                return std::make_pair(FingerprintGrid(expandedGrid), expandedGrid.GetNumberOfBlocks());
+                });
+            for (std::size_t i = 0; i < keptGrids.size(); i++)
+                transpositions->Store(keptGrids[i]->Hash, fingerprints[i].first, fingerprints[i].second, keptGrids[i]->Score, depth + 1);
+        }
+        totalTranspositionLookups += transpositionLookups;
+        totalTranspositionHits += transpositionHits;
+
+        history.EndDepth();
+        history.Prune([&](auto&& addLink) {
+            // the grids of a spilled beam are only seen while its runs are merged
+            if (spilled)
+                spilledGrids->Finish(runMemory, beamWidth, addLink);
+            else
+                for (const CompactGrid* grid : grids->GetGrids())
+                    addLink(grid->History);
+            });
+
+        beamSize = spilled ? spilledGrids->Size() : grids->Size();
 
-        if (newBeamSize == 0)
+        if (beamSize == 0 || perfectScoreFound)
             stop = true;
 
-        grids = std::move(newGrids);
-        beamSize = newBeamSize;
+        // the block data of the grids of this depth is released all at once
+        newGrids->Clear();
+        arena->Reset();
+        std::swap(arena, newArena);
 		gridsDiscarded = totalDiscarded;
+
+        // the depths still to come are estimated from the blocks the leading grid removed per move at the last few depths
+        if (leadingGridBlocks.has_value())
+        {
+            recentLeadingGridBlocks.push_back(*leadingGridBlocks);
+            if (recentLeadingGridBlocks.size() > DepthEstimateWindow + 1)
+                recentLeadingGridBlocks.pop_front();
+
+            unsigned int oldBlocks = recentLeadingGridBlocks.front();
+            unsigned int newBlocks = recentLeadingGridBlocks.back();
+            if (newBlocks < oldBlocks)
+                depthsLeft = std::max(static_cast<double>(newBlocks) * (recentLeadingGridBlocks.size() - 1) / (oldBlocks - newBlocks) - 1.0, 1.0);
+        }
+
+        std::size_t numEvaluated = numChildren + totalDiscarded;
+        if (deadline.has_value() && gridsSolved > 0 && numEvaluated > 0)
+        {
+            // the time per child is averaged over depths, as it is inflated by the fixed costs of a depth the narrower the beam is
+            double depthSecondsPerChild = std::chrono::duration<double>(std::chrono::steady_clock::now() - depthStart).count() / numEvaluated;
+            secondsPerChild = secondsPerChild == 0.0 ? depthSecondsPerChild : (secondsPerChild + depthSecondsPerChild) / 2;
+            childrenPerGrid = static_cast<double>(numEvaluated) / gridsSolved;
+        }
     }
 
-    std::tuple<unsigned int, unsigned int> Solver::SolveGrid(const Grid& grid, Score score, std::map<Score, GridHashSet>& newGrids, bool& stop)
+    std::optional<std::size_t> Solver::GetBeamWidth() const
     {
-        static thread_local std::vector<Group> groups;
-        grid.GetGroups(groups, minGroupSize);
+        std::optional<std::size_t> width = GetMemoryBeamWidth();
+        std::optional<std::size_t> timeWidth = GetTimeBeamWidth();
+        if (timeWidth.has_value())
+            width = std::min(width.value_or(*timeWidth), *timeWidth);
+        return width;
+    }
 
-        unsigned int numNewGridsInserted = 0;
-	    unsigned int numNewGridsDiscarded = 0;
+    std::optional<std::size_t> Solver::GetMemoryBeamWidth() const
+    {
+        // beams that are spilled to disk only need to fit into the memory while they are built
+        if (!MaxMemory.has_value() || SpillDirectory.has_value())
+            return MaxBeamSize;
+
+        // Besides what the beams take, memory is used by the history and by the pending grids, for which as much
+        // headroom is kept as they took at the previous depth. As the beams of two consecutive depths are held
+        // at the same time, every beam gets half of the rest of the budget, or less if the current beam takes more.
+        // The grids of a beam take up the bytes per grid measured for the current beam, in its hash set and with its
+        // block data, and the beam merges about as many more grids than it keeps as at the previous depth.
+        double fixedMemory = static_cast<double>(baselineMemory + history.GetNumberOfEntries() * sizeof(MoveLink) +
+            std::max(pendingMemoryUsage, newGrids->GetPendingMemoryUsage()));
+        double bytesPerGrid = std::max(grids->GetBytesPerGrid(), static_cast<double>(sizeof(CompactGrid)));
+        double beamMemory = std::max(*MaxMemory - fixedMemory, 0.0);
+        double currentBeamMemory = grids->MergedSize() * bytesPerGrid;
+        double newBeamMemory = std::min(beamMemory / 2, std::max(beamMemory - currentBeamMemory, 0.0));
+        double newBeamSize = newBeamMemory / bytesPerGrid - static_cast<double>(mergedBeyondKept);
+
+        // the search goes on with a single grid rather than giving up if the budget is exhausted
+        std::size_t width = static_cast<std::size_t>(std::max(newBeamSize, 1.0));
+        if (MaxBeamSize.has_value())
+            width = std::min<std::size_t>(width, *MaxBeamSize);
+
+        return width;
+    }
+
+    std::optional<std::size_t> Solver::GetTimeBeamWidth() const
+    {
+        // nothing is known about the time a depth takes before the first one with more than the initial grid is finished
+        if (!deadline.has_value() || secondsPerChild == 0.0 || depthsLeft == 0.0)
+            return std::nullopt;
+
+        // Expanding a grid is taken to cost as many children as grids had on average at the last depth, each taking as long
+        // as a child took then. The current beam is expanded first and the rest of the time is split evenly between the beams
+        // of the depths still to come, which are estimated from the blocks the leading grid removed per move so far.
+        double secondsPerGrid = secondsPerChild * childrenPerGrid;
+        double secondsLeft = std::chrono::duration<double>(*deadline - std::chrono::steady_clock::now()).count();
+        double secondsForNewBeams = secondsLeft - beamSize * secondsPerGrid;
+        double width = secondsForNewBeams / std::max(depthsLeft - 1.0, 1.0) / secondsPerGrid;
+
+        // once the time is up, the search goes on greedily
+        return static_cast<std::size_t>(std::clamp(width, 1.0, static_cast<double>(std::numeric_limits<unsigned int>::max())));
+    }
+
+    std::size_t Solver::GetRunMemory() const
+    {
+        // Besides what the history and the pending grids take up, as with GetMemoryBeamWidth, half of the budget is left to the beam
+        // of the next depth before it is spilled. The other half goes to the grids of the current depth, which are either
+        // held in memory or read from disk in two batches at a time.
+        std::size_t fixedMemory = baselineMemory + history.GetNumberOfEntries() * sizeof(MoveLink) +
+            std::max(pendingMemoryUsage, newGrids->GetPendingMemoryUsage());
+        return std::max((*MaxMemory - std::min(fixedMemory, *MaxMemory)) / 2, MinRunMemory);
+    }
+
+    void Solver::CompleteLeadingGrid()
+    {
+        std::vector<CompactGrid> spilledLeadingGrid;
+        BumpArena spilledArena;
+        const CompactGrid* leadingGrid = nullptr;
+
+        if (spilledGrids && spilledGrids->HasRuns())
+        {
+            spilledGrids->ReadGrids(spilledLeadingGrid, spilledArena, 1);
+            if (!spilledLeadingGrid.empty())
+                leadingGrid = &spilledLeadingGrid.front();
+        }
+        else if (grids->Size() > 0)
+            leadingGrid = grids->GetGrids().front();
+
+        if (leadingGrid == nullptr)
+            return;
+
+        // The group whose removal gives the best score is removed until no groups are left or the maximum depth is reached.
+        // The leading grid is at the depth after the last one that was expanded.
+        Grid grid = leadingGrid->Expand();
+        Score score = leadingGrid->Score;
+        std::vector<unsigned char> steps;
+        GroupList groups;
+        std::optional<unsigned int> maxSteps;
+        if (MaxDepth.has_value())
+            maxSteps = *MaxDepth - std::min(*MaxDepth, depth + 1);
+
+        while (!maxSteps.has_value() || steps.size() < *maxSteps)
+        {
+            grid.GetGroups(groups, minGroupSize);
+            if (groups.empty())
+                break;
 
-        auto getOrCreateHashSet = [&](const Score& score) -> GridHashSet& {
+            std::optional<Grid> bestGrid;
+            std::optional<Score> bestGridScore;
+            unsigned char bestStep = 0;
+
+            for (std::size_t i = 0; i < groups.size(); i++)
             {
-                std::shared_lock lock(mutex);
-                auto it = newGrids.find(score);                
-                if (it != newGrids.end())
-                    return it->second;
+                Grid newGrid = grid;
+                newGrid.RemoveGroup(groups[i]);
+                Score newScore = scoring->RemoveGroup(score, grid, groups, i, newGrid, minGroupSize);
+
+                if (!bestGridScore.has_value() || newScore < *bestGridScore)
+                {
+                    bestGrid = std::move(newGrid);
+                    bestGridScore = newScore;
+                    bestStep = static_cast<unsigned char>(i);
+                }
             }
+
+            grid = std::move(*bestGrid);
+            score = *bestGridScore;
+            steps.push_back(bestStep);
+        }
+
+        // as in SolveGrid, a grid at the maximum depth is a solution even if groups are left, unless only clearing solutions are reported
+        if ((bestScore.has_value() && score.Value >= *bestScore) || (ClearingSolutionsOnly && !grid.IsEmpty()))
+            return;
+
+        bestScore = score.Value;
+        solution = solutionPrefix.Append(history.GetSolution(leadingGrid->History)).Append(Solution(steps));
+        solutionGrid = std::move(grid);
+        solutionGrid->Solution = solution;
+        ReportImprovement();
+    }
+
+    void Solver::ResumeFromCheckpoint(const Grid& grid)
+    {
+        CheckpointReader reader(*CheckpointFile);
+        const CheckpointState& state = reader.GetState();
+
+        if (state.StartGrid.Width != startGrid->Width || state.StartGrid.Height != startGrid->Height ||
+            !std::equal(startGrid->BlocksBegin(), startGrid->BlocksEnd(), state.StartGrid.BlocksBegin()) ||
+            state.MinGroupSize != minGroupSize || state.StartScore.Value != startScore.Value || state.StartScore.Objective != startScore.Objective)
+            throw std::runtime_error(std::format("Checkpoint file {} was written for a different grid or scoring", CheckpointFile->string()));
+
+        depth = state.Depth;
+        gridsDiscarded = state.GridsDiscarded;
+        mergedBeyondKept = state.MergedBeyondKept;
+        pendingMemoryUsage = state.PendingMemoryUsage;
+        history.Restore(state.History);
+
+        if (state.BestScore.has_value())
+        {
+            bestScore = state.BestScore;
+            bestLink = state.BestLink;
+            bestDepth = state.BestDepth;
+            solution = state.BestSolution;
+            solutionGrid = grid;
+            solutionGrid->ApplySolution(solution, minGroupSize);
+            solutionGrid->Solution = solution;
+            ReportImprovement();
+        }
+
+        // The grids are merged into the beam again, which sorts them as they were sorted before, and are spilled to disk
+        // as they would have been at the end of the depth. Their histories still refer to the restored history.
+        std::size_t runMemory = spilledGrids ? GetRunMemory() : 0;
+        grids->SetMaxSize(std::nullopt);
+        CompactGrid compactGrid;
+        std::size_t numPending = 0;
+
+        while (reader.Read(compactGrid))
+        {
+            grids->Add(compactGrid.Expand(), compactGrid.Hash, compactGrid.Score, compactGrid.History);
+
+            if (++numPending == MaxPendingGrids)
             {
-                std::unique_lock lock(mutex);
-                return newGrids[score];
+                grids->Merge(*arena);
+                numPending = 0;
+
+                if (spilledGrids && grids->GetMergedMemoryUsage() + arena->GetMemoryUsage() > runMemory)
+                {
+                    spilledGrids->Spill(*grids);
+                    grids->DropMerged();
+                    arena->Reset();
+                }
             }
-        };
+        }
+
+        grids->Merge(*arena);
+
+        if (spilledGrids && spilledGrids->HasRuns())
+        {
+            spilledGrids->Spill(*grids);
+            grids->DropMerged();
+            arena->Reset();
+            spilledGrids->Finish(runMemory, std::nullopt, [](const MoveLink&) {});
+        }
+
+        grids->Sort();
+        beamSize = static_cast<unsigned int>(reader.GetNumberOfGrids());
+    }
+
+    CheckpointState Solver::GetCheckpointState() const
+    {
+        CheckpointState state;
+        state.StartGrid = *startGrid;
+        state.MinGroupSize = minGroupSize;
+        state.StartScore = startScore;
+        state.Depth = depth;
+        state.BeamSize = beamSize;
+        state.GridsDiscarded = gridsDiscarded;
+        state.MergedBeyondKept = mergedBeyondKept;
+        state.PendingMemoryUsage = pendingMemoryUsage;
+        state.BestScore = bestScore;
+        state.BestSolution = solution;
+        state.BestLink = bestLink;
+        state.BestDepth = bestDepth;
+        state.History = history.GetTables();
+        return state;
+    }
+
+    const std::vector<Beam::Bucket>& Solver::GetBuckets() const
+    {
+        return spilledGrids && spilledGrids->HasRuns() ? spilledGrids->GetBuckets() : grids->GetBuckets();
+    }
+
+    std::tuple<unsigned int, unsigned int> Solver::SolveGrid(const Grid& grid, std::uint32_t hash, Score score, std::uint32_t historyIndex, unsigned int slot, std::atomic_bool& stop)
+    {
+        static thread_local GroupList groups;
+        grid.GetGroups(groups, minGroupSize);
+
+        // children are built in a per-thread grid whose block storage is reused,
+        // so the only allocation per child is the one of the packed CompactGrid
+        static thread_local Grid newGrid(0, 0);
+
+        unsigned int numNewGridsAdded = 0;
+	    unsigned int numNewGridsDiscarded = 0;
+        unsigned int numLookups = 0;
+        unsigned int numHits = 0;
+        // children have as many blocks as their parent less those of the removed group
+        unsigned int numBlocks = transpositions ? grid.GetNumberOfBlocks() : 0;
 
         for (int i = 0; i < groups.size(); i++)
         {
-            Grid newGrid(grid.Width, grid.Height, grid.Blocks.get(), grid.Solution.Append(i));
-            newGrid.RemoveGroup(groups[i]);
+            newGrid.RemoveGroup(grid, groups[i]);
+            MoveLink link{ historyIndex, static_cast<unsigned char>(i) };
 
             if (ClearingSolutionsOnly && MaxDepth.has_value() && origNumColors + depth >= *MaxDepth)
             {
@@ -284,14 +907,21 @@ namespace sgbust
                 }
             }
 
-            Score newScore = scoring->RemoveGroup(score, grid, groups[i], newGrid, minGroupSize);
+            Score newScore = scoring->RemoveGroup(score, grid, groups, i, newGrid, minGroupSize);
 
             bool maxDepthReached = MaxDepth.has_value() && depth == *MaxDepth - 1;
 
             if (!newGrid.HasGroups(minGroupSize) || maxDepthReached)
-                CheckSolution(newGrid, newScore, stop);
+                CheckSolution(newGrid, newScore, link, stop);
             else
             {
+                // children that cannot make it into the beam are dropped before they are packed
+                if (!newGrids->Admits(newScore))
+                {
+                    numNewGridsDiscarded++;
+                    continue;
+                }
+
                 if (ClearingSolutionsOnly)
                 {
                     auto colorCounts = newGrid.GetColorCounts();
@@ -302,65 +932,78 @@ namespace sgbust
                     }
                 }
 
-                auto [it, inserted] = getOrCreateHashSet(newScore).insert(CompactGrid(std::move(newGrid)));
-                if (inserted)
-                    numNewGridsInserted++;
+                // the hash of the child is derived from that of its parent, rehashing only the columns that changed
+                std::uint32_t newHash = UpdateGridHash(hash, grid, groups[i], newGrid);
+
+                if (transpositions)
+                {
+                    numLookups++;
+                    // the hash alone is too narrow for billions of lookups, a different grid with an equal hash would be dropped unsearched
+                    if (transpositions->Contains(newHash, FingerprintGrid(newGrid), numBlocks - static_cast<unsigned int>(groups[i].size()), newScore))
+                    {
+                        numHits++;
+                        continue;
+                    }
+                }
+
+                newGrids->Add(newGrid, newHash, newScore, link, slot);
+                numNewGridsAdded++;
             }
         }
 
-        return std::make_tuple(numNewGridsInserted, numNewGridsDiscarded);
+        if (numLookups != 0)
+        {
+            transpositionLookups += numLookups;
+            transpositionHits += numHits;
+        }
+
+        return std::make_tuple(numNewGridsAdded, numNewGridsDiscarded);
     }
 
-    void Solver::CheckSolution(const Grid& grid, Score score, bool& stop)
+    void Solver::CheckSolution(const Grid& grid, Score score, const MoveLink& link, std::atomic_bool& stop)
     {
-        if (!stop && (!bestScore.has_value() || score.Value < *bestScore))
+        if (!stop && IsBetterSolution(score.Value, link))
         {
             if (ClearingSolutionsOnly && !grid.IsEmpty())
 				return;
 
             std::scoped_lock lock(mutex);
 
-            if (!stop && (!bestScore.has_value() || score.Value < *bestScore))
+            if (!stop && IsBetterSolution(score.Value, link))
             {
                 bestScore = score.Value;
-                solution = solutionPrefix.Append(grid.Solution);
+                bestLink = link;
+                bestDepth = depth;
+                solution = solutionPrefix.Append(history.GetSolution(link));
                 solutionGrid = grid;
                 solutionGrid->Solution = solution;
+                ReportImprovement();
 
+                // with deterministic results, the depth is finished since a perfect solution with a lesser link may still be found
                 if (scoring->IsPerfectScore(score))
-                    stop = true;
+                {
+                    if (Deterministic)
+                        perfectScoreFound = true;
+                    else
+                        stop = true;
+                }
             }
         }
     }
 
-    void Solver::TrimBeam()
+    bool Solver::IsBetterSolution(int score, const MoveLink& link) const
     {
-        if (MaxBeamSize && multiplier > 1)
-        {
-            unsigned int reducedBeamSize = std::ceil(*MaxBeamSize / multiplier * TrimmingSafetyFactor);
-
-            if (beamSize > reducedBeamSize)
-            {
-                unsigned int accumulatedSize = 0;
-
-                auto it = grids.begin();
-                for (; ; it++)
-                {
-                    accumulatedSize += it->second.size();
-                    if (accumulatedSize >= reducedBeamSize)
-                        break;
-                }
-
-                GridHashSet& hashSet = it->second;
-                auto it2 = hashSet.begin();
-                std::advance(it2, accumulatedSize - reducedBeamSize);
-                hashSet.erase(hashSet.begin(), it2);
+        if (!bestScore.has_value() || score < *bestScore)
+            return true;
 
-                it++;
-                grids.erase(it, grids.end());
+        // solutions with equal scores found at the same depth are ordered by their links
+        return Deterministic && score == *bestScore && depth == bestDepth && link < bestLink;
+    }
 
-                beamSize = reducedBeamSize;
-            }
-        }
+    void Solver::ReportImprovement() const
+    {
+        if (OnImprovement)
+            OnImprovement(SolverImprovement{ *bestScore, solution, solutionGrid->GetNumberOfBlocks(), solution.GetLength() - solutionPrefix.GetLength(),
+                std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime) });
     }
 }
\ No newline at end of file
@@ -0,0 +1,61 @@
+#include "core/TranspositionTable.h"
+
+#include <algorithm>
+#include <bit>
+#include <limits>
+
+namespace sgbust
+{
+    TranspositionTable::TranspositionTable(std::size_t size)
+    {
+        std::size_t numBuckets = std::max<std::size_t>(std::bit_floor(size / (BucketSize * sizeof(Entry))), 2);
+        bucketBits = std::countr_zero(numBuckets);
+        entries.resize(numBuckets * BucketSize);
+    }
+
+    std::size_t TranspositionTable::GetBucket(std::uint32_t hash) const
+    {
+        // Fibonacci hashing, the upper bits of the product depend on all bits of the hash
+        return static_cast<std::size_t>((hash * 0x9E3779B97F4A7C15ull) >> (64 - bucketBits)) * BucketSize;
+    }
+
+    bool TranspositionTable::Contains(std::uint32_t hash, std::uint32_t fingerprint, unsigned int numBlocks, const Score& score) const
+    {
+        const Entry* bucket = entries.data() + GetBucket(hash);
+
+        for (std::size_t i = 0; i < BucketSize; i++)
+            if (bucket[i].Depth != 0 && bucket[i].Hash == hash && bucket[i].Fingerprint == fingerprint && bucket[i].NumBlocks == numBlocks)
+                return !(score < bucket[i].Score);
+
+        return false;
+    }
+
+    void TranspositionTable::Store(std::uint32_t hash, std::uint32_t fingerprint, unsigned int numBlocks, const Score& score, unsigned int depth)
+    {
+        Entry* bucket = entries.data() + GetBucket(hash);
+        Entry* replaced = bucket;
+
+        for (std::size_t i = 0; i < BucketSize; i++)
+        {
+            Entry& entry = bucket[i];
+
+            // a grid that is kept again is recorded with the better score and the later depth
+            if (entry.Depth != 0 && entry.Hash == hash && entry.Fingerprint == fingerprint && entry.NumBlocks == numBlocks)
+            {
+                if (score < entry.Score)
+                    entry.Score = score;
+                entry.Depth = static_cast<std::uint16_t>(std::min<unsigned int>(depth, std::numeric_limits<std::uint16_t>::max()));
+                return;
+            }
+
+            if (entry.Depth < replaced->Depth)
+                replaced = &entry;
+        }
+
+        replaced->Hash = hash;
+        replaced->Fingerprint = fingerprint;
+        replaced->NumBlocks = static_cast<std::uint16_t>(numBlocks);
+        replaced->Depth = static_cast<std::uint16_t>(std::min<unsigned int>(depth, std::numeric_limits<std::uint16_t>::max()));
+        replaced->Score = score;
+    }
+}
\ No newline at end of file
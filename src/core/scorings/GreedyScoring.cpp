@@ -19,9 +19,9 @@ namespace sgbust
         return Score(score);
     }
 
-    Score GreedyScoring::RemoveGroup(const Score& oldScore, const Grid& oldGrid, const Group& group, const Grid& newGrid, unsigned int minGroupSize) const
+    Score GreedyScoring::RemoveGroup(const Score& oldScore, const Grid& oldGrid, const GroupList& oldGroups, std::size_t groupIndex, const Grid& newGrid, unsigned int minGroupSize) const
     {
-        int newScore = oldScore.Value - groupScore(group.size());
+        int newScore = oldScore.Value - groupScore(oldGroups[groupIndex].size());
 
         if (clearanceBonus != 0 && newGrid.IsEmpty())
             newScore -= clearanceBonus;
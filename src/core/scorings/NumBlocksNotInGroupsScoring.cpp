@@ -2,22 +2,33 @@
 
 #include <numeric>
 
+namespace
+{
+    sgbust::Score GetNumBlocksNotInGroups(const sgbust::Grid& grid, const sgbust::GroupList& groups)
+    {
+        int numBlocksInGroups = std::transform_reduce(groups.begin(), groups.end(), 0, std::plus<>(), [](const auto& group) { return group.size(); });
+        int numBlocksNotInGroups = grid.GetNumberOfBlocks() - numBlocksInGroups;
+
+        return sgbust::Score(numBlocksNotInGroups);
+    }
+}
+
 namespace sgbust
 {
     Score NumBlocksNotInGroupsScoring::CreateScore(const Grid& grid, unsigned int minGroupSize) const
     {
-        static thread_local std::vector<Group> groups;
+        static thread_local GroupList groups;
         grid.GetGroups(groups, minGroupSize);
 
-        int numBlocksInGroups = std::transform_reduce(groups.begin(), groups.end(), 0, std::plus<>(), [](const auto& group) { return group.size(); });
-        int numBlocksNotInGroups = grid.GetNumberOfBlocks() - numBlocksInGroups;
-
-        return Score(numBlocksNotInGroups);
+        return GetNumBlocksNotInGroups(grid, groups);
     }
 
-    Score NumBlocksNotInGroupsScoring::RemoveGroup(const Score& oldScore, const Grid& oldGrid, const Group& group, const Grid& newGrid, unsigned int minGroupSize) const
+    Score NumBlocksNotInGroupsScoring::RemoveGroup(const Score& oldScore, const Grid& oldGrid, const GroupList& oldGroups, std::size_t groupIndex, const Grid& newGrid, unsigned int minGroupSize) const
     {
-        return CreateScore(newGrid, minGroupSize);
+        static thread_local GroupList groups;
+        newGrid.GetGroups(groups, minGroupSize, oldGrid, oldGroups, groupIndex);
+
+        return GetNumBlocksNotInGroups(newGrid, groups);
     }
 
     bool NumBlocksNotInGroupsScoring::IsPerfectScore(const Score& score) const
@@ -11,7 +11,7 @@ namespace sgbust
 
     Score PotentialScoring::CreateScore(const Grid& grid, unsigned int minGroupSize) const
     {
-        static thread_local std::vector<Group> groups;
+        static thread_local GroupList groups;
         grid.GetGroups(groups, minGroupSize);
 
         int score = 0;
@@ -26,12 +26,12 @@ namespace sgbust
         return Score(score, score - potentialGroupsScore);
     }
 
-    Score PotentialScoring::RemoveGroup(const Score& oldScore, const Grid& oldGrid, const Group& group, const Grid& newGrid, unsigned int minGroupSize) const
+    Score PotentialScoring::RemoveGroup(const Score& oldScore, const Grid& oldGrid, const GroupList& oldGroups, std::size_t groupIndex, const Grid& newGrid, unsigned int minGroupSize) const
     {
-        static thread_local std::vector<Group> groups;
-        newGrid.GetGroups(groups, minGroupSize);
+        static thread_local GroupList groups;
+        newGrid.GetGroups(groups, minGroupSize, oldGrid, oldGroups, groupIndex);
 
-        int newScore = oldScore.Value - groupScore(group.size());
+        int newScore = oldScore.Value - groupScore(oldGroups[groupIndex].size());
 
         if (clearanceBonus != 0 && newGrid.IsEmpty())
             newScore -= clearanceBonus;